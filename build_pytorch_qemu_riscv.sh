@@ -21,6 +21,10 @@
 #   --pytorch-source PATH      Optional PyTorch source directory for the build step
 #   --pytorch-branch REF       Git branch/tag/commit to checkout when building PyTorch
 #   --pytorch-clone-url URL    Alternate PyTorch remote when cloning
+#   --pytorch-vector           Build the rv64gcv libtorch variant (build_pytorch_riscv.sh --vector,
+#                              default install artifacts/pytorch-install-rvv); needs a V guest CPU
+#   --pytorch-blas NAME        BLAS for the PyTorch build: none or openblas (build_pytorch_riscv.sh --blas)
+#   --pytorch-xnnpack          Build XNNPACK into libtorch (build_pytorch_riscv.sh --xnnpack)
 #   --jobs N                   Number of parallel build jobs (default: nproc)
 #   --clean                    Clean build directories before building
 #   --help                     Show this help message
@@ -37,6 +41,9 @@ BUILD_PYTORCH=0
 PYTORCH_SOURCE_DIR=""
 PYTORCH_BRANCH="v2.3.0"
 PYTORCH_CLONE_URL="https://github.com/pytorch/pytorch.git"
+PYTORCH_VECTOR=0
+PYTORCH_BLAS=""
+PYTORCH_XNNPACK=0
 
 # Versions
 OPENSBI_VERSION="v1.7"
@@ -95,6 +102,18 @@ while [[ $# -gt 0 ]]; do
             PYTORCH_CLONE_URL="$2"
             shift 2
             ;;
+        --pytorch-vector)
+            PYTORCH_VECTOR=1
+            shift
+            ;;
+        --pytorch-blas)
+            PYTORCH_BLAS="$2"
+            shift 2
+            ;;
+        --pytorch-xnnpack)
+            PYTORCH_XNNPACK=1
+            shift
+            ;;
         --jobs)
             BUILD_JOBS="$2"
             shift 2
@@ -116,7 +135,11 @@ done
 
 # Validate requirements
 if [ $BUILD_PYTORCH -eq 1 ] && [ -z "$PYTORCH_INSTALL" ]; then
-    PYTORCH_INSTALL="$PWD/artifacts/pytorch-install"
+    if [ $PYTORCH_VECTOR -eq 1 ]; then
+        PYTORCH_INSTALL="$PWD/artifacts/pytorch-install-rvv"
+    else
+        PYTORCH_INSTALL="$PWD/artifacts/pytorch-install"
+    fi
 fi
 
 if [ -z "$PYTORCH_INSTALL" ]; then
@@ -142,6 +165,15 @@ if [ $BUILD_PYTORCH -eq 1 ]; then
     if [ -n "$PYTORCH_CLONE_URL" ]; then
         BUILD_CMD+=(--clone-url "$PYTORCH_CLONE_URL")
     fi
+    if [ $PYTORCH_VECTOR -eq 1 ]; then
+        BUILD_CMD+=(--vector)
+    fi
+    if [ -n "$PYTORCH_BLAS" ]; then
+        BUILD_CMD+=(--blas "$PYTORCH_BLAS")
+    fi
+    if [ $PYTORCH_XNNPACK -eq 1 ]; then
+        BUILD_CMD+=(--xnnpack)
+    fi
     "${BUILD_CMD[@]}"
 fi
 
@@ -350,8 +382,15 @@ mkdir -p "$ROOTFS_DIR/usr/local/lib"
 
 log_info "Copying PyTorch libraries..."
 if [ -d "$PYTORCH_INSTALL/lib" ]; then
-    cp -v "$PYTORCH_INSTALL/lib"/*.so* "$ROOTFS_DIR/usr/local/lib/" 2>&1 | head -20
-    log_info "✓ PyTorch libraries copied"
+    # Copy without piping cp's output through head: a closed pipe would stop
+    # cp partway through the list.
+    cp "$PYTORCH_INSTALL/lib"/*.so* "$ROOTFS_DIR/usr/local/lib/"
+    log_info "✓ PyTorch libraries copied ($(ls "$PYTORCH_INSTALL/lib"/*.so* | wc -l) files)"
+    # A libtorch built with --blas openblas carries libopenblas in the same
+    # prefix; libtorch_cpu needs it (and libgomp from the sysroot) at runtime.
+    if ls "$PYTORCH_INSTALL/lib"/libopenblas*.so* >/dev/null 2>&1; then
+        log_info "✓ OpenBLAS staged: $(basename "$(readlink -f "$PYTORCH_INSTALL/lib/libopenblas.so")")"
+    fi
 else
     log_error "PyTorch lib directory not found: $PYTORCH_INSTALL/lib"
     exit 1
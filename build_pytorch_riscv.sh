@@ -11,12 +11,25 @@ usage: ./build_pytorch_riscv.sh [options]
 
 Options:
   --toolchain PATH      RISC-V cross toolchain root (bin/ + sysroot/) [required]
-  --install PATH        Install prefix for riscv libtorch output      [default: artifacts/pytorch-install]
+  --install PATH        Install prefix for riscv libtorch output      [default: artifacts/pytorch-install,
+                                                                       artifacts/pytorch-install-rvv with --vector]
   --source PATH         Existing PyTorch source directory             [default: artifacts/pytorch-src]
   --clone-url URL       PyTorch git remote                            [default: https://github.com/pytorch/pytorch.git]
   --branch REF          Git branch/tag/commit to build                [default: v2.3.0]
   --jobs N              Parallel build jobs                           [default: nproc]
   --force-fetch         Reclone PyTorch even if the source directory exists
+  --vector              Build the rv64gcv variant: ATen CPU kernels compiled for RVV and
+                        SLEEF's RVV backends, in its own build dir and install prefix.
+                        Needs GCC 14+ and a guest CPU with v=true
+  --sleef-ref REF       SLEEF tag for --vector (RVV support starts at 3.6) [default: 3.6.1]
+  --blas NAME           BLAS for libtorch matmuls: none (ATen's own GEMM) or openblas,
+                        cross-compiled into the install prefix     [default: none]
+  --openblas-ref REF    OpenBLAS tag for --blas openblas             [default: v0.3.28]
+  --openblas-target T   OpenBLAS TARGET                              [default: RISCV64_GENERIC,
+                                                                       RISCV64_ZVL128B with --vector]
+  --xnnpack             Build XNNPACK into libtorch for the prepacked linear ops behind
+                        qwen3_infer --xnnpack (scalar microkernels; RVV ones with --vector).
+                        Needs a PyTorch whose pinned XNNPACK knows riscv64
   --help                This message
 USAGE
 }
@@ -28,6 +41,13 @@ CLONE_URL="https://github.com/pytorch/pytorch.git"
 BRANCH="v2.3.0"
 JOBS="$(nproc)"
 FORCE_FETCH=0
+VECTOR=0
+SLEEF_REF="3.6.1"
+BLAS="none"
+OPENBLAS_REF="v0.3.28"
+OPENBLAS_TARGET=""
+OPENBLAS_URL="https://github.com/OpenMathLib/OpenBLAS.git"
+XNNPACK=0
 
 while [[ $# -gt 0 ]]; do
   case "$1" in
@@ -45,6 +65,18 @@ while [[ $# -gt 0 ]]; do
       JOBS="$2"; shift 2 ;;
     --force-fetch)
       FORCE_FETCH=1; shift ;;
+    --vector)
+      VECTOR=1; shift ;;
+    --sleef-ref)
+      SLEEF_REF="$2"; shift 2 ;;
+    --blas)
+      BLAS="$2"; shift 2 ;;
+    --openblas-ref)
+      OPENBLAS_REF="$2"; shift 2 ;;
+    --openblas-target)
+      OPENBLAS_TARGET="$2"; shift 2 ;;
+    --xnnpack)
+      XNNPACK=1; shift ;;
     --help|-h)
       usage; exit 0 ;;
     *)
@@ -59,12 +91,45 @@ if [[ -z "$TOOLCHAIN_ROOT" ]]; then
   exit 1
 fi
 
+if [[ "$BLAS" != "none" && "$BLAS" != "openblas" ]]; then
+  echo "error: --blas must be none or openblas" >&2
+  exit 1
+fi
+
 if [[ ! -x "$TOOLCHAIN_ROOT/bin/riscv64-unknown-linux-gnu-gcc" ]]; then
   echo "error: riscv64-unknown-linux-gnu-gcc not found under $TOOLCHAIN_ROOT/bin" >&2
   exit 1
 fi
 
-INSTALL_PREFIX=${INSTALL_PREFIX:-"$REPO_ROOT/artifacts/pytorch-install"}
+# The vector variant keeps its own install prefix and target build trees, so
+# both libtorch builds can sit side by side for A/B runs. Host tools (protoc)
+# are shared.
+if [[ $VECTOR -eq 1 ]]; then
+  VARIANT_SUFFIX="-rvv"
+  # ATen's native CPU kernels are only built per CPU capability when
+  # INTERN_BUILD_ATEN_OPS is on; riscv64 has just the DEFAULT capability,
+  # whose Vectorized<T> loops GCC vectorizes for RVV under -march=rv64gcv.
+  TARGET_FLAGS="-march=rv64gcv -mabi=lp64d"
+  ATEN_OPS=ON
+  # GCC 13 accepts -march=rv64gcv but its RVV intrinsics and autovectorizer
+  # predate the ratified API the kernels use.
+  GCC_VERSION=$("$TOOLCHAIN_ROOT/bin/riscv64-unknown-linux-gnu-gcc" -dumpversion)
+  if [[ ${GCC_VERSION%%.*} -lt 14 ]]; then
+    echo "error: --vector needs GCC 14+, but $TOOLCHAIN_ROOT has GCC $GCC_VERSION" >&2
+    exit 1
+  fi
+  if ! echo | "$TOOLCHAIN_ROOT/bin/riscv64-unknown-linux-gnu-gcc" $TARGET_FLAGS -dM -E - \
+      | grep -q '__riscv_vector'; then
+    echo "error: $TOOLCHAIN_ROOT does not support -march=rv64gcv (GCC 14+ needed for --vector)" >&2
+    exit 1
+  fi
+else
+  VARIANT_SUFFIX=""
+  TARGET_FLAGS="-D__riscv_v_intrinsic=0"
+  ATEN_OPS=OFF
+fi
+
+INSTALL_PREFIX=${INSTALL_PREFIX:-"$REPO_ROOT/artifacts/pytorch-install$VARIANT_SUFFIX"}
 SOURCE_DIR=${SOURCE_DIR:-"$REPO_ROOT/artifacts/pytorch-src"}
 BUILD_ROOT="$REPO_ROOT/artifacts/pytorch-build"
 
@@ -82,14 +147,47 @@ else
   # (cd "$SOURCE_DIR" && git fetch --tags && git checkout "$BRANCH" && git submodule update --init --recursive)
 fi
 
-(cd "$SOURCE_DIR" && git submodule update --init --recursive third_party/sleef third_party/protobuf third_party/onnx)
+SUBMODULES=(third_party/sleef third_party/protobuf third_party/onnx)
+if [[ $XNNPACK -eq 1 ]]; then
+  SUBMODULES+=(third_party/XNNPACK third_party/cpuinfo third_party/pthreadpool third_party/FXdiv third_party/FP16 third_party/psimd)
+fi
+(cd "$SOURCE_DIR" && git submodule update --init --recursive "${SUBMODULES[@]}")
+
+# XNNPACK is linked statically into libtorch_cpu and picks its microkernels at
+# runtime through cpuinfo. Its RVV kernels are compiled with -march=rv64gcv, so
+# they are only enabled for the vector variant. QNNPACK and NNPACK stay off:
+# they only have x86 and Arm kernels.
+XNNPACK_FLAGS=(-DUSE_XNNPACK=OFF)
+if [[ $XNNPACK -eq 1 ]]; then
+  if ! grep -qi 'riscv' "$SOURCE_DIR/third_party/XNNPACK/CMakeLists.txt"; then
+    echo "error: the XNNPACK pinned by PyTorch $BRANCH has no riscv64 support; pick a newer --branch" >&2
+    exit 1
+  fi
+  if [[ $VECTOR -eq 1 ]]; then
+    XNNPACK_FLAGS=(-DUSE_XNNPACK=ON -DXNNPACK_ENABLE_RISCV_VECTOR=ON)
+  else
+    XNNPACK_FLAGS=(-DUSE_XNNPACK=ON -DXNNPACK_ENABLE_RISCV_VECTOR=OFF)
+  fi
+fi
+
+# PyTorch's pinned SLEEF predates its RVV backends. The vector build moves the
+# submodule to SLEEF_REF; the submodule update above puts it back for scalar
+# builds.
+if [[ $VECTOR -eq 1 ]]; then
+  echo "Checking out SLEEF $SLEEF_REF for the RVV backends"
+  git -C "$SOURCE_DIR/third_party/sleef" fetch --depth 1 origin "refs/tags/$SLEEF_REF:refs/tags/$SLEEF_REF"
+  git -C "$SOURCE_DIR/third_party/sleef" checkout --quiet "$SLEEF_REF"
+  SLEEF_TARGET_FLAGS=(-DSLEEF_ENFORCE_RVVM1=ON -DSLEEF_ENFORCE_RVVM2=ON)
+else
+  SLEEF_TARGET_FLAGS=()
+fi
 
-SLEEF_BUILD="$BUILD_ROOT/sleef-native"
-SLEEF_INSTALL="$BUILD_ROOT/sleef-native-install"
+SLEEF_BUILD="$BUILD_ROOT/sleef-native$VARIANT_SUFFIX"
+SLEEF_INSTALL="$BUILD_ROOT/sleef-native-install$VARIANT_SUFFIX"
 PROTOBUF_BUILD="$BUILD_ROOT/protobuf-native"
 PROTOC_LEGACY="$PROTOBUF_BUILD/protoc-3.13.0.0"
-PYTORCH_BUILD="$BUILD_ROOT/pytorch"
-ONNX_BUILD="$BUILD_ROOT/onnx-shared"
+PYTORCH_BUILD="$BUILD_ROOT/pytorch$VARIANT_SUFFIX"
+ONNX_BUILD="$BUILD_ROOT/onnx-shared$VARIANT_SUFFIX"
 TOOLCHAIN_DIR="$BUILD_ROOT/toolchains"
 mkdir -p "$SLEEF_BUILD" "$SLEEF_INSTALL" "$PROTOBUF_BUILD" "$PYTORCH_BUILD" "$ONNX_BUILD" "$TOOLCHAIN_DIR"
 
@@ -121,7 +219,7 @@ set(CMAKE_CXX_COMPILER "${TOOLCHAIN_ROOT}/bin/riscv64-unknown-linux-gnu-g++")
 set(CMAKE_ASM_COMPILER "${TOOLCHAIN_ROOT}/bin/riscv64-unknown-linux-gnu-gcc")
 set(CMAKE_C_COMPILER_TARGET "riscv64-unknown-linux-gnu")
 set(CMAKE_CXX_COMPILER_TARGET "riscv64-unknown-linux-gnu")
-set(CMAKE_FIND_ROOT_PATH "${TOOLCHAIN_ROOT}/riscv64-unknown-linux-gnu" "${TOOLCHAIN_ROOT}/sysroot")
+set(CMAKE_FIND_ROOT_PATH "${TOOLCHAIN_ROOT}/riscv64-unknown-linux-gnu" "${TOOLCHAIN_ROOT}/sysroot" "${INSTALL_PREFIX}")
 set(CMAKE_FIND_ROOT_PATH_MODE_PROGRAM NEVER)
 set(CMAKE_FIND_ROOT_PATH_MODE_LIBRARY ONLY)
 set(CMAKE_FIND_ROOT_PATH_MODE_INCLUDE ONLY)
@@ -131,7 +229,8 @@ set(CMAKE_C_FLAGS_INIT "--sysroot=${TOOLCHAIN_ROOT}/sysroot")
 set(CMAKE_CXX_FLAGS_INIT "--sysroot=${TOOLCHAIN_ROOT}/sysroot")
 TOOL
 
-cat >"$TOOLCHAIN_DIR/riscv64_libtorch.cmake" <<TOOL
+LIBTORCH_TOOLCHAIN="$TOOLCHAIN_DIR/riscv64_libtorch$VARIANT_SUFFIX.cmake"
+cat >"$LIBTORCH_TOOLCHAIN" <<TOOL
 set(CMAKE_SYSTEM_NAME Linux)
 set(CMAKE_SYSTEM_PROCESSOR riscv64)
 set(RISCV_ROOT "$TOOLCHAIN_ROOT" CACHE PATH "RISC-V toolchain root")
@@ -208,6 +307,49 @@ if needle in text:
 PY_SCHEMA
 fi
 
+# OpenBLAS goes into the libtorch install prefix: FindOpenBLAS picks it up
+# there (OpenBLAS_HOME), libtorch_cpu gets it as a runtime dependency, and
+# build_pytorch_qemu_riscv.sh stages it with the rest of lib/. It uses the
+# same OpenMP runtime as libtorch, so the two never oversubscribe the harts.
+BLAS_FLAGS=()
+if [[ "$BLAS" == "openblas" ]]; then
+  if [[ -z "$OPENBLAS_TARGET" ]]; then
+    if [[ $VECTOR -eq 1 ]]; then
+      OPENBLAS_TARGET="RISCV64_ZVL128B"
+    else
+      OPENBLAS_TARGET="RISCV64_GENERIC"
+    fi
+  fi
+  OPENBLAS_SRC="$BUILD_ROOT/openblas-src-$OPENBLAS_REF"
+  if [[ ! -d "$OPENBLAS_SRC" ]]; then
+    echo "Cloning OpenBLAS $OPENBLAS_REF"
+    git clone --depth 1 --branch "$OPENBLAS_REF" "$OPENBLAS_URL" "$OPENBLAS_SRC"
+  fi
+  # C_LAPACK builds LAPACK from its C translation, so no Fortran compiler is
+  # needed and torch.linalg still gets LAPACK.
+  OPENBLAS_MAKE_ARGS=(
+    TARGET="$OPENBLAS_TARGET"
+    HOSTCC="$HOST_CC"
+    CC="$TOOLCHAIN_ROOT/bin/riscv64-unknown-linux-gnu-gcc --sysroot=$TOOLCHAIN_ROOT/sysroot"
+    BINARY=64
+    NOFORTRAN=1
+    C_LAPACK=1
+    USE_OPENMP=1
+    NUM_THREADS=64
+    NO_STATIC=1
+  )
+  echo "Building OpenBLAS $OPENBLAS_REF (TARGET=$OPENBLAS_TARGET)"
+  # A previous build for another TARGET leaves objects behind.
+  if [[ ! -f "$OPENBLAS_SRC/.qwen_target" || "$(cat "$OPENBLAS_SRC/.qwen_target")" != "$OPENBLAS_TARGET" ]]; then
+    make -C "$OPENBLAS_SRC" clean >/dev/null
+  fi
+  make -C "$OPENBLAS_SRC" "${OPENBLAS_MAKE_ARGS[@]}" -j"$JOBS" libs netlib shared
+  echo "$OPENBLAS_TARGET" >"$OPENBLAS_SRC/.qwen_target"
+  make -C "$OPENBLAS_SRC" "${OPENBLAS_MAKE_ARGS[@]}" PREFIX="$INSTALL_PREFIX" install
+  export OpenBLAS_HOME="$INSTALL_PREFIX"
+  BLAS_FLAGS=(-DUSE_BLAS=ON -DBLAS=OpenBLAS -DUSE_LAPACK=ON)
+fi
+
 CPUINFO_API_C="$SOURCE_DIR/third_party/cpuinfo/src/api.c"
 if [[ -f "$CPUINFO_API_C" ]] && ! grep -q "#define _GNU_SOURCE" "$CPUINFO_API_C"; then
   echo "Patching cpuinfo api.c to define _GNU_SOURCE for syscall()"
@@ -234,7 +376,6 @@ cmake -S "$SOURCE_DIR" \
       -DUSE_NUMPY=OFF \
       -DUSE_CUDA=OFF \
       -DUSE_ROCM=OFF \
-      -DUSE_XNNPACK=OFF \
       -DUSE_PYTORCH_QNNPACK=OFF \
       -DUSE_QNNPACK=OFF \
       -DUSE_MKLDNN=OFF \
@@ -247,13 +388,16 @@ cmake -S "$SOURCE_DIR" \
       -DUSE_MPI=OFF \
       -DUSE_GLOO=OFF \
       -DBUILD_TEST=OFF \
-      -DINTERN_BUILD_ATEN_OPS=OFF \
+      -DINTERN_BUILD_ATEN_OPS="$ATEN_OPS" \
+      ${BLAS_FLAGS[@]+"${BLAS_FLAGS[@]}"} \
+      "${XNNPACK_FLAGS[@]}" \
+      ${SLEEF_TARGET_FLAGS[@]+"${SLEEF_TARGET_FLAGS[@]}"} \
       -DNATIVE_BUILD_DIR="$SLEEF_BUILD" \
       -DCAFFE2_CUSTOM_PROTOC_EXECUTABLE="$PROTOC_LEGACY" \
       -DPROTOBUF_PROTOC_EXECUTABLE="$PROTOC_LEGACY" \
       -DONNX_CUSTOM_PROTOC_EXECUTABLE="$PROTOC_LEGACY" \
-      -DCMAKE_C_FLAGS="--sysroot=${TOOLCHAIN_ROOT}/sysroot -D__riscv_v_intrinsic=0" \
-      -DCMAKE_CXX_FLAGS="--sysroot=${TOOLCHAIN_ROOT}/sysroot -D__riscv_v_intrinsic=0"
+      -DCMAKE_C_FLAGS="--sysroot=${TOOLCHAIN_ROOT}/sysroot $TARGET_FLAGS" \
+      -DCMAKE_CXX_FLAGS="--sysroot=${TOOLCHAIN_ROOT}/sysroot $TARGET_FLAGS"
 
 ninja -C "$PYTORCH_BUILD" "$PYTORCH_BUILD/third_party/onnx/onnx/onnx_onnx_torch-ml.pb.h"
 mkdir -p "$PYTORCH_BUILD/onnx"
@@ -340,7 +484,7 @@ fi
 cmake -S "$SOURCE_DIR/third_party/onnx" \
       -B "$ONNX_BUILD" \
       -GNinja \
-      -DCMAKE_TOOLCHAIN_FILE="$TOOLCHAIN_DIR/riscv64_libtorch.cmake" \
+      -DCMAKE_TOOLCHAIN_FILE="$LIBTORCH_TOOLCHAIN" \
       -DCMAKE_BUILD_TYPE=Release \
       -DBUILD_SHARED_LIBS=ON \
       -DONNX_NAMESPACE=onnx_torch \
@@ -374,8 +518,11 @@ cmake --build "$ONNX_BUILD" --target install --parallel "$JOBS"
 cat <<EOF
 
 PyTorch cross-build completed.
+  Variant        : $( [[ $VECTOR -eq 1 ]] && echo "rv64gcv (vector ATen kernels, SLEEF $SLEEF_REF RVV)" || echo "rv64gc (scalar)" )
+  BLAS           : $( [[ "$BLAS" == "openblas" ]] && echo "OpenBLAS $OPENBLAS_REF ($OPENBLAS_TARGET)" || echo "none (ATen GEMM)" )
+  XNNPACK        : $( [[ $XNNPACK -eq 1 ]] && echo "on (prepacked linear ops for qwen3_infer --xnnpack)" || echo "off" )
   Install prefix : $INSTALL_PREFIX
-  Key libraries  : $INSTALL_PREFIX/lib/libtorch.so, libtorch_cpu.so, libc10.so, libonnx*.so
+  Key libraries  : $INSTALL_PREFIX/lib/libtorch.so, libtorch_cpu.so, libc10.so, libonnx*.so$( [[ "$BLAS" == "openblas" ]] && echo ", libopenblas.so" )
 
 Pass --pytorch "$INSTALL_PREFIX" to build_pytorch_qemu_riscv.sh.
 EOF
@@ -0,0 +1,195 @@
+#include "batching.h"
+
+#include "paged_kv_cache.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+namespace qwen3 {
+namespace {
+// Left-pads the sequence dimension of a [layers, batch, heads, seq, dim] cache.
+torch::Tensor pad_cache(const torch::Tensor& cache, int64_t pad) {
+  return pad > 0 ? torch::constant_pad_nd(cache, {0, 0, pad, 0}, 0) : cache;
+}
+
+torch::Tensor pad_mask(const torch::Tensor& mask, int64_t pad) {
+  return pad > 0 ? torch::constant_pad_nd(mask, {pad, 0}, 0) : mask;
+}
+}  // namespace
+
+void BatchKvCache::add(const torch::Tensor& keys,
+                       const torch::Tensor& values,
+                       const torch::Tensor& attention_mask) {
+  TORCH_CHECK(keys.dim() == 5 && keys.sizes() == values.sizes(),
+              "BatchKvCache::add expects matching 5-D key/value caches");
+  TORCH_CHECK(empty() || keys.scalar_type() == keys_.scalar_type(),
+              "BatchKvCache::add: cannot mix ", keys.scalar_type(), " and ",
+              keys_.scalar_type(), " caches in one batch");
+  TORCH_CHECK(attention_mask.dim() == 2 && attention_mask.size(0) == keys.size(1) &&
+                  attention_mask.size(1) == keys.size(3),
+              "BatchKvCache::add: attention mask does not match the cache shape");
+  const torch::Tensor mask = attention_mask.to(torch::kLong);
+  if (empty()) {
+    keys_ = keys;
+    values_ = values;
+    attention_mask_ = mask;
+    return;
+  }
+
+  const int64_t current = length();
+  const int64_t incoming = keys.size(3);
+  const int64_t target = std::max(current, incoming);
+  keys_ = torch::cat({pad_cache(keys_, target - current), pad_cache(keys, target - incoming)}, 1);
+  values_ =
+      torch::cat({pad_cache(values_, target - current), pad_cache(values, target - incoming)}, 1);
+  attention_mask_ = torch::cat(
+      {pad_mask(attention_mask_, target - current), pad_mask(mask, target - incoming)}, 0);
+}
+
+torch::Tensor BatchKvCache::decode(Qwen3Model& model,
+                                   const torch::Tensor& tokens,
+                                   const torch::Tensor& position_ids) {
+  TORCH_CHECK(!empty(), "BatchKvCache::decode called on an empty batch");
+  TORCH_CHECK(tokens.size(0) == batch_size(), "BatchKvCache::decode: expected ", batch_size(),
+              " rows, got ", tokens.size(0));
+  const torch::Tensor step_mask = torch::cat(
+      {attention_mask_, torch::ones({batch_size(), tokens.size(1)}, attention_mask_.options())}, 1);
+  StepOutput past;
+  past.keys = keys_;
+  past.values = values_;
+  StepOutput out = model.decode_step(tokens, past, step_mask, position_ids);
+  keys_ = out.keys;
+  values_ = out.values;
+  attention_mask_ = step_mask;
+  return out.logits;
+}
+
+void BatchKvCache::retain(const std::vector<int64_t>& rows) {
+  if (empty() || static_cast<int64_t>(rows.size()) == batch_size()) {
+    return;
+  }
+  if (rows.empty()) {
+    keys_ = torch::Tensor();
+    values_ = torch::Tensor();
+    attention_mask_ = torch::Tensor();
+    return;
+  }
+  const torch::Tensor index = torch::tensor(rows, torch::kLong);
+  keys_ = keys_.index_select(1, index);
+  values_ = values_.index_select(1, index);
+  attention_mask_ = attention_mask_.index_select(0, index);
+
+  // Columns that were only needed by evicted rows are dead for everyone left.
+  const torch::Tensor live_columns = attention_mask_.sum(0).gt(0).nonzero();
+  const int64_t first_live = live_columns.numel() > 0 ? live_columns[0].item<int64_t>() : 0;
+  if (first_live > 0) {
+    const int64_t kept = length() - first_live;
+    keys_ = keys_.narrow(3, first_live, kept);
+    values_ = values_.narrow(3, first_live, kept);
+    attention_mask_ = attention_mask_.narrow(1, first_live, kept);
+  }
+}
+
+std::unique_ptr<DecodeCache> make_decode_cache(const ExportConfig& config,
+                                               const GenerationOptions& options) {
+  if (options.kv_pages <= 0) {
+    return std::make_unique<BatchKvCache>();
+  }
+  if (!config.paged_kv) {
+    throw std::runtime_error(
+        "Model was exported without decode_step_paged; re-export it to use a paged KV cache");
+  }
+  if (options.kv_cache == KvCacheDtype::kInt8) {
+    throw std::invalid_argument("A paged KV cache holds float keys and values; it cannot be int8");
+  }
+  return std::make_unique<PagedKvCache>(options.kv_pages);
+}
+
+std::vector<std::vector<int64_t>> generate_batch(Qwen3Model& model,
+                                                 const std::vector<std::vector<int64_t>>& prompts,
+                                                 const GenerationOptions& options) {
+  torch::NoGradGuard no_grad;
+  const ExportConfig& config = model.config();
+  check_sampling_supported(config, options.sampling);
+  std::vector<std::vector<int64_t>> sequences = prompts;
+  if (options.max_new_tokens <= 0 || prompts.empty()) {
+    return sequences;
+  }
+  if (!config.prefill_decode) {
+    for (std::vector<int64_t>& sequence : sequences) {
+      sequence = generate(model, sequence, options);
+    }
+    return sequences;
+  }
+
+  const int64_t batch = static_cast<int64_t>(prompts.size());
+  size_t width = 0;
+  for (const std::vector<int64_t>& prompt : prompts) {
+    TORCH_CHECK(!prompt.empty(), "generate_batch: empty prompt");
+    width = std::max(width, prompt.size());
+  }
+  torch::Tensor tokens = torch::zeros({batch, static_cast<int64_t>(width)}, torch::kLong);
+  torch::Tensor mask = torch::zeros_like(tokens);
+  for (int64_t i = 0; i < batch; ++i) {
+    const std::vector<int64_t>& prompt = prompts[i];
+    const int64_t pad = static_cast<int64_t>(width - prompt.size());
+    const int64_t len = static_cast<int64_t>(prompt.size());
+    std::copy(prompt.begin(), prompt.end(), tokens[i].data_ptr<int64_t>() + pad);
+    mask[i].narrow(0, pad, len).fill_(1);
+  }
+
+  const std::unique_ptr<DecodeCache> cache = make_decode_cache(config, options);
+  StepOutput state = model.prefill(tokens, mask, options.kv_cache);
+  cache->add(state.keys, state.values, mask);
+  torch::Tensor logits = state.logits;
+
+  // Every row gets its own sampler with the shared seed, so a prompt samples
+  // the same continuation as it would on its own.
+  std::vector<Sampler> samplers(prompts.size(), Sampler(options.sampling));
+  // rows[r] is the prompt index held in cache row r.
+  std::vector<int64_t> rows(prompts.size());
+  std::iota(rows.begin(), rows.end(), 0);
+
+  for (int step = 0; step < options.max_new_tokens; ++step) {
+    std::vector<int64_t> keep;
+    keep.reserve(rows.size());
+    for (size_t r = 0; r < rows.size(); ++r) {
+      std::vector<int64_t>& sequence = sequences[rows[r]];
+      const torch::Tensor history = torch::from_blob(
+          sequence.data(), {static_cast<int64_t>(sequence.size())}, torch::kLong);
+      const int64_t next_token = select_token(config, options.sampling, samplers[rows[r]],
+                                              logits.index({static_cast<int64_t>(r), -1}), history);
+      sequence.push_back(next_token);
+      if (!(options.eos_token >= 0 && next_token == options.eos_token)) {
+        keep.push_back(static_cast<int64_t>(r));
+      }
+    }
+    if (keep.empty() || step + 1 == options.max_new_tokens) {
+      break;
+    }
+
+    cache->retain(keep);
+    std::vector<int64_t> remaining;
+    remaining.reserve(keep.size());
+    for (int64_t r : keep) {
+      remaining.push_back(rows[r]);
+    }
+    rows = std::move(remaining);
+
+    const int64_t active = static_cast<int64_t>(rows.size());
+    torch::Tensor step_tokens = torch::empty({active, 1}, torch::kLong);
+    torch::Tensor positions = torch::empty({active, 1}, torch::kLong);
+    int64_t* token_data = step_tokens.data_ptr<int64_t>();
+    int64_t* position_data = positions.data_ptr<int64_t>();
+    for (int64_t r = 0; r < active; ++r) {
+      const std::vector<int64_t>& sequence = sequences[rows[r]];
+      token_data[r] = sequence.back();
+      position_data[r] = static_cast<int64_t>(sequence.size()) - 1;
+    }
+    logits = cache->decode(model, step_tokens, positions);
+  }
+  return sequences;
+}
+
+}  // namespace qwen3
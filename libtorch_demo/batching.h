@@ -0,0 +1,72 @@
+#pragma once
+
+#include <torch/script.h>
+
+#include "generation.h"
+#include "model.h"
+
+#include <memory>
+#include <vector>
+
+namespace qwen3 {
+
+// KV cache for a batch of sequences that can join (after their own prefill)
+// and leave between decode steps.
+class DecodeCache {
+ public:
+  virtual ~DecodeCache() = default;
+
+  virtual int64_t batch_size() const = 0;
+
+  // Appends rows from a prefill: keys/values [layers, rows, kv_heads, len,
+  // head_dim] and their [rows, len] attention mask.
+  virtual void add(const torch::Tensor& keys,
+                   const torch::Tensor& values,
+                   const torch::Tensor& attention_mask) = 0;
+
+  // Advances every row by one token. tokens and position_ids are [batch, 1];
+  // returns the step's logits (or token ids for an argmax head).
+  virtual torch::Tensor decode(Qwen3Model& model,
+                               const torch::Tensor& tokens,
+                               const torch::Tensor& position_ids) = 0;
+
+  // Keeps only the listed rows, in order.
+  virtual void retain(const std::vector<int64_t>& rows) = 0;
+};
+
+// KV cache shared by a batch of sequences of different lengths. Rows are
+// left-padded to a common length and the padding is masked out, so one
+// decode_step call advances every row by one token.
+class BatchKvCache : public DecodeCache {
+ public:
+  bool empty() const { return !keys_.defined(); }
+  int64_t batch_size() const override { return empty() ? 0 : keys_.size(1); }
+  int64_t length() const { return empty() ? 0 : keys_.size(3); }
+  const torch::Tensor& attention_mask() const { return attention_mask_; }
+
+  void add(const torch::Tensor& keys, const torch::Tensor& values, const torch::Tensor& attention_mask) override;
+  torch::Tensor decode(Qwen3Model& model, const torch::Tensor& tokens, const torch::Tensor& position_ids) override;
+  // Also drops leading columns that have become padding for every remaining row.
+  void retain(const std::vector<int64_t>& rows) override;
+
+ private:
+  torch::Tensor keys_;
+  torch::Tensor values_;
+  torch::Tensor attention_mask_;
+};
+
+// The batch cache options select: a PagedKvCache when options.kv_pages > 0,
+// otherwise a padded BatchKvCache. Throws if the model cannot decode from it.
+std::unique_ptr<DecodeCache> make_decode_cache(const ExportConfig& config,
+                                               const GenerationOptions& options);
+
+// Generates for every prompt as one left-padded batch: a single prefill over
+// all rows, then one decode_step per token for the rows still running. Rows
+// stop independently at EOS or max_new_tokens and are evicted from the cache.
+// Returns each prompt followed by its generated tokens, in input order.
+// Legacy archives without decode_step fall back to one generate() per prompt.
+std::vector<std::vector<int64_t>> generate_batch(Qwen3Model& model,
+                                                 const std::vector<std::vector<int64_t>>& prompts,
+                                                 const GenerationOptions& options);
+
+}  // namespace qwen3
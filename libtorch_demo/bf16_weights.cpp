@@ -0,0 +1,109 @@
+#include "bf16_weights.h"
+
+#include "linear_common.h"
+
+#include <ATen/Parallel.h>
+#include <torch/library.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace qwen3 {
+namespace {
+// Output rows per task; matches the int8 kernel's tiling.
+constexpr int64_t kRowTile = 64;
+}  // namespace
+
+at::Tensor bf16_linear(const at::Tensor& input,
+                       const at::Tensor& weight,
+                       const c10::optional<at::Tensor>& bias) {
+  TORCH_CHECK(weight.dim() == 2 && at::isReducedFloatingType(weight.scalar_type()),
+              "bf16_linear: weight must be a 2-D bfloat16 or float16 tensor");
+  const int64_t out_features = weight.size(0);
+  const int64_t width = weight.size(1);
+  TORCH_CHECK(input.size(-1) == width, "bf16_linear: input size ", input.size(-1),
+              " does not match weight width ", width);
+
+  const at::Tensor rows = flatten_input(input, width);
+  const int64_t m = rows.size(0);
+  const at::Tensor w = weight.contiguous();
+  at::Tensor bias_storage;
+  const float* bp = bias_data(bias, bias_storage);
+  at::Tensor out = at::empty({m, out_features}, rows.options());
+
+  const float* x = rows.data_ptr<float>();
+  float* y = out.data_ptr<float>();
+  const int64_t tiles = (out_features + kRowTile - 1) / kRowTile;
+  AT_DISPATCH_REDUCED_FLOATING_TYPES(w.scalar_type(), "bf16_linear", [&] {
+    const scalar_t* wp = w.data_ptr<scalar_t>();
+    at::parallel_for(0, tiles, 1, [&](int64_t begin, int64_t end) {
+      std::vector<float> widened(static_cast<size_t>(width));
+      for (int64_t tile = begin; tile < end; ++tile) {
+        const int64_t row_end = std::min(out_features, (tile + 1) * kRowTile);
+        for (int64_t n = tile * kRowTile; n < row_end; ++n) {
+          // Widen once per weight row and reuse it for every input row.
+          const scalar_t* wn = wp + n * width;
+          for (int64_t k = 0; k < width; ++k) {
+            widened[k] = static_cast<float>(wn[k]);
+          }
+          for (int64_t i = 0; i < m; ++i) {
+            const float* xi = x + i * width;
+            float acc = 0.0f;
+            for (int64_t k = 0; k < width; ++k) {
+              acc += xi[k] * widened[k];
+            }
+            y[i * out_features + n] = acc + (bp != nullptr ? bp[n] : 0.0f);
+          }
+        }
+      }
+    });
+  });
+
+  return finish_linear(out, input, out_features);
+}
+
+at::Tensor bf16_embedding(const at::Tensor& input_ids, const at::Tensor& weight) {
+  TORCH_CHECK(weight.dim() == 2 && at::isReducedFloatingType(weight.scalar_type()),
+              "bf16_embedding: weight must be a 2-D bfloat16 or float16 tensor");
+  const int64_t vocab = weight.size(0);
+  const int64_t hidden = weight.size(1);
+  const at::Tensor ids = input_ids.reshape({-1}).to(at::kLong).contiguous();
+  const int64_t count = ids.numel();
+  const at::Tensor w = weight.contiguous();
+  at::Tensor out = at::empty({count, hidden}, w.options().dtype(at::kFloat));
+
+  const int64_t* idp = ids.data_ptr<int64_t>();
+  float* y = out.data_ptr<float>();
+  for (int64_t i = 0; i < count; ++i) {
+    TORCH_CHECK(idp[i] >= 0 && idp[i] < vocab, "bf16_embedding: token id ", idp[i],
+                " out of range for vocab ", vocab);
+  }
+  AT_DISPATCH_REDUCED_FLOATING_TYPES(w.scalar_type(), "bf16_embedding", [&] {
+    const scalar_t* wp = w.data_ptr<scalar_t>();
+    at::parallel_for(0, count, 1, [&](int64_t begin, int64_t end) {
+      for (int64_t i = begin; i < end; ++i) {
+        const scalar_t* row = wp + idp[i] * hidden;
+        float* dst = y + i * hidden;
+        for (int64_t k = 0; k < hidden; ++k) {
+          dst[k] = static_cast<float>(row[k]);
+        }
+      }
+    });
+  });
+
+  std::vector<int64_t> out_shape(input_ids.sizes().begin(), input_ids.sizes().end());
+  out_shape.push_back(hidden);
+  return out.reshape(out_shape);
+}
+
+}  // namespace qwen3
+
+TORCH_LIBRARY_FRAGMENT(qwen, m) {
+  m.def("bf16_linear(Tensor input, Tensor weight, Tensor? bias) -> Tensor");
+  m.def("bf16_embedding(Tensor input_ids, Tensor weight) -> Tensor");
+}
+
+TORCH_LIBRARY_IMPL(qwen, CPU, m) {
+  m.impl("bf16_linear", &qwen3::bf16_linear);
+  m.impl("bf16_embedding", &qwen3::bf16_embedding);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <ATen/ATen.h>
+
+#include <c10/util/Optional.h>
+
+namespace qwen3 {
+
+// Kernels for weights stored as bf16 (or fp16) on CPUs without fast
+// half-precision math: weights are widened to fp32 a row at a time and all
+// arithmetic is fp32, so storage and bandwidth halve without a half-precision
+// matmul path. bf16 keeps fp32's range; fp16 keeps three more mantissa bits
+// for weights known to fit its range.
+
+// input @ weight.T + bias with a bf16 or fp16 [out_features, in_features]
+// weight. The result has input's dtype. Registered for TorchScript as
+// qwen::bf16_linear.
+at::Tensor bf16_linear(const at::Tensor& input,
+                       const at::Tensor& weight,
+                       const c10::optional<at::Tensor>& bias);
+
+// Rows of a bf16 or fp16 [vocab, hidden] table for each id, as fp32
+// [..., hidden]. Registered for TorchScript as qwen::bf16_embedding.
+at::Tensor bf16_embedding(const at::Tensor& input_ids, const at::Tensor& weight);
+
+}  // namespace qwen3
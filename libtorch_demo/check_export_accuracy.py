@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""Compares a quantized TorchScript export against a float reference.
+
+Both archives must come from export_qwen3_torchscript.py with the logits head.
+The reference decodes greedily from the prompt; the candidate is fed the same
+tokens (teacher forcing), so every step compares logits for an identical
+context. Reports top-1 agreement, KL(reference || candidate) and the largest
+absolute logit difference, and fails when agreement drops below a threshold.
+"""
+
+import argparse
+import sys
+from pathlib import Path
+from typing import List, Tuple
+
+import torch
+
+import qwen3_custom_ops  # noqa: F401  (Python kernels for the qwen:: ops)
+
+EXPORT_CONFIG_NAME = "qwen3_export.cfg"
+
+
+def load_export(path: Path) -> torch.jit.ScriptModule:
+    extra_files = {EXPORT_CONFIG_NAME: ""}
+    module = torch.jit.load(str(path), map_location="cpu", _extra_files=extra_files)
+    config = dict(
+        line.split("=", 1) for line in extra_files[EXPORT_CONFIG_NAME].splitlines() if "=" in line
+    )
+    if config.get("interface") != "prefill_decode":
+        raise ValueError(f"{path} was not exported with the prefill/decode interface")
+    if config.get("head", "logits") != "logits":
+        raise ValueError(f"{path} returns token ids; export it with --head logits to compare")
+    return module
+
+
+def load_prompt(path: Path) -> List[int]:
+    tokens = [int(token) for token in path.read_text().split()]
+    if not tokens:
+        raise ValueError(f"Token file is empty: {path}")
+    return tokens
+
+
+def run_steps(
+    module: torch.jit.ScriptModule, prompt: List[int], forced: List[int] | None, steps: int
+) -> Tuple[List[torch.Tensor], List[int]]:
+    """Returns the last-position logits of every step and the tokens fed back.
+
+    With forced=None the module picks its own greedy tokens.
+    """
+    tokens = torch.tensor([prompt], dtype=torch.long)
+    mask = torch.ones_like(tokens)
+    logits, keys, values = module.prefill(tokens, mask)
+    all_logits = []
+    fed = []
+    for step in range(steps):
+        row = logits[0, -1].to(torch.float32)
+        all_logits.append(row)
+        next_token = int(row.argmax()) if forced is None else forced[step]
+        fed.append(next_token)
+        if step + 1 == steps:
+            break
+        token = torch.tensor([[next_token]], dtype=torch.long)
+        mask = torch.cat([mask, torch.ones_like(token)], dim=1)
+        position_ids = torch.full_like(token, mask.size(1) - 1)
+        logits, keys, values = module.decode_step(token, keys, values, mask, position_ids)
+    return all_logits, fed
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--reference", type=Path, required=True, help="Float TorchScript export")
+    parser.add_argument("--candidate", type=Path, required=True, help="Quantized export to check")
+    parser.add_argument(
+        "--prompt-tokens",
+        type=Path,
+        default=Path(__file__).resolve().parent.parent
+        / "overlays/rootfs_alpine/usr/local/share/qwen/prompt_tokens.txt",
+    )
+    parser.add_argument("--steps", type=int, default=32, help="Generated positions to compare")
+    parser.add_argument(
+        "--min-agreement",
+        type=float,
+        default=0.9,
+        help="Fail when fewer than this fraction of steps share the reference's top-1 token",
+    )
+    args = parser.parse_args()
+
+    prompt = load_prompt(args.prompt_tokens)
+    with torch.inference_mode():
+        reference_logits, tokens = run_steps(load_export(args.reference), prompt, None, args.steps)
+        candidate_logits, _ = run_steps(load_export(args.candidate), prompt, tokens, args.steps)
+
+    agree = 0
+    kl_values = []
+    max_abs = 0.0
+    for ref, cand in zip(reference_logits, candidate_logits):
+        agree += int(ref.argmax() == cand.argmax())
+        ref_log_probs = torch.log_softmax(ref, -1)
+        cand_log_probs = torch.log_softmax(cand, -1)
+        kl_values.append(float((ref_log_probs.exp() * (ref_log_probs - cand_log_probs)).sum()))
+        max_abs = max(max_abs, float((ref - cand).abs().max()))
+
+    agreement = agree / len(reference_logits)
+    print(f"prompt tokens:      {len(prompt)}")
+    print(f"steps compared:     {len(reference_logits)}")
+    print(f"top-1 agreement:    {agreement:.3f} ({agree}/{len(reference_logits)})")
+    print(f"KL mean / max:      {sum(kl_values) / len(kl_values):.5f} / {max(kl_values):.5f}")
+    print(f"max |logit diff|:   {max_abs:.4f}")
+    if agreement < args.min_agreement:
+        print(f"FAIL: agreement below {args.min_agreement}", file=sys.stderr)
+        return 1
+    print("OK")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -120,7 +120,9 @@ importlib.metadata.version = _patched_version
 from transformers import AutoModelForCausalLM, AutoTokenizer
 importlib.metadata.version = _real_importlib_version
 
-from typing import Dict
+import qwen3_custom_ops  # noqa: F401  (registers torch.ops.qwen.* for tracing)
+
+from typing import Dict, Tuple
 
 
 def resolve_dtype(dtype_str: str) -> torch.dtype:
@@ -217,26 +219,598 @@ def install_torchscript_friendly_mask() -> None:
     masking_utils.ALL_MASK_ATTENTION_FUNCTIONS["eager"] = eager_mask
 
 
+def install_custom_attention(vector_ops: bool = False) -> None:
+    """Routes eager attention to the qwen:: kernels where the cache needs them.
+
+    decode_step_paged passes its page pool as the paged_kv keyword, which the
+    model forwards to every attention call; the layer's pages are gathered by
+    qwen::paged_attention. The int8 entry points store packed keys/values
+    (qwen::quantize_kv), so attention over int8 tensors goes to
+    qwen::int8_kv_attention. Everything else stays on the eager path, except
+    that vector_ops swaps its softmax for qwen::softmax_lastdim.
+    """
+    from transformers.models.qwen3 import modeling_qwen3
+
+    eager_attention = modeling_qwen3.eager_attention_forward
+
+    def attention(module, query, key, value, attention_mask, scaling, dropout=0.0, **kwargs):
+        paged_kv = kwargs.pop("paged_kv", None)
+        if paged_kv is not None:
+            key_pages, value_pages, block_tables, context_lens = paged_kv
+            output = torch.ops.qwen.paged_attention(
+                query,
+                key,
+                value,
+                key_pages[module.layer_idx],
+                value_pages[module.layer_idx],
+                block_tables,
+                context_lens,
+                scaling,
+            )
+            return output.transpose(1, 2).contiguous(), None
+        if key.dtype != torch.int8 and vector_ops:
+            key = modeling_qwen3.repeat_kv(key, module.num_key_value_groups)
+            value = modeling_qwen3.repeat_kv(value, module.num_key_value_groups)
+            scores = torch.matmul(query, key.transpose(2, 3)) * scaling
+            if attention_mask is not None:
+                scores = scores + attention_mask[:, :, :, : key.shape[-2]]
+            weights = torch.ops.qwen.softmax_lastdim(scores)
+            output = torch.matmul(weights, value)
+            return output.transpose(1, 2).contiguous(), weights
+        if key.dtype != torch.int8:
+            return eager_attention(
+                module, query, key, value, attention_mask, scaling, dropout, **kwargs
+            )
+        if attention_mask is not None:
+            attention_mask = attention_mask[:, :, :, : key.shape[-2]]
+        output = torch.ops.qwen.int8_kv_attention(query, key, value, attention_mask, scaling)
+        return output.transpose(1, 2).contiguous(), None
+
+    modeling_qwen3.eager_attention_forward = attention
+
+
+EXPORT_CONFIG_NAME = "qwen3_export.cfg"
+
+
+class Int8Linear(torch.nn.Module):
+    """Weight-only int8 replacement for nn.Linear.
+
+    Weights are quantized symmetrically with one fp32 scale per output channel;
+    qwen::int8_linear dequantizes inside its GEMV loop, so only a quarter of the
+    fp32 weight bytes are read per token.
+    """
+
+    def __init__(self, weight: torch.Tensor, bias: torch.Tensor | None):
+        super().__init__()
+        weight = weight.detach().to(torch.float32)
+        scale = weight.abs().amax(dim=1).clamp(min=1e-8) / 127.0
+        qweight = torch.round(weight / scale.unsqueeze(1)).clamp(-127, 127).to(torch.int8)
+        self.register_buffer("qweight", qweight)
+        self.register_buffer("scale", scale)
+        self.bias = bias
+
+    def forward(self, x: torch.Tensor) -> torch.Tensor:
+        return torch.ops.qwen.int8_linear(x, self.qweight, self.scale, self.bias)
+
+
+class Int4Linear(torch.nn.Module):
+    """Weight-only 4-bit group-quantized replacement for nn.Linear.
+
+    Every run of group_size input columns in a row has an fp16 scale and
+    zero-point, w ~ (q - zero) * scale with q in [0, 15]. Two q values share a
+    byte, the even column in the low nibble. qwen::int4_linear unpacks them and
+    accumulates in fp32.
+    """
+
+    def __init__(self, weight: torch.Tensor, bias: torch.Tensor | None, group_size: int):
+        super().__init__()
+        weight = weight.detach().to(torch.float32)
+        out_features, in_features = weight.shape
+        if in_features % group_size != 0 or group_size % 2 != 0:
+            raise ValueError(
+                f"group size {group_size} must be even and divide in_features={in_features}"
+            )
+        groups = weight.reshape(out_features, in_features // group_size, group_size)
+        # The range always includes 0, so the zero-point lands in [0, 15]: a
+        # constant (or far-from-zero) group would otherwise get a zero-width
+        # range and a zero-point that overflows fp16.
+        w_min = groups.amin(dim=-1).clamp(max=0.0)
+        w_max = groups.amax(dim=-1).clamp(min=0.0)
+        # Quantize against the fp16-rounded parameters the kernel will use. Only
+        # an all-zero group still has no range; its scale is floored after
+        # rounding so the division below stays finite.
+        scales = ((w_max - w_min) / 15.0).to(torch.float16)
+        scales = scales.clamp(min=torch.finfo(torch.float16).tiny)
+        zeros = (-w_min / scales.to(torch.float32)).clamp(0.0, 15.0).to(torch.float16)
+        q = torch.round(
+            groups / scales.to(torch.float32).unsqueeze(-1) + zeros.to(torch.float32).unsqueeze(-1)
+        )
+        q = q.clamp(0, 15).to(torch.uint8).reshape(out_features, in_features)
+        self.register_buffer("qweight", q[:, 0::2] | (q[:, 1::2] << 4))
+        self.register_buffer("scales", scales)
+        self.register_buffer("zeros", zeros)
+        self.group_size = group_size
+        self.bias = bias
+
+    def forward(self, x: torch.Tensor) -> torch.Tensor:
+        return torch.ops.qwen.int4_linear(
+            x, self.qweight, self.scales, self.zeros, self.group_size, self.bias
+        )
+
+
+class Bf16Linear(torch.nn.Module):
+    """nn.Linear with bf16 (or fp16) weight storage and fp32 compute.
+
+    For CPUs without native half-precision math: qwen::bf16_linear widens the
+    weights to fp32 one row at a time, so memory and bandwidth halve while
+    activations and accumulation stay fp32.
+    """
+
+    def __init__(
+        self,
+        weight: torch.Tensor,
+        bias: torch.Tensor | None,
+        storage_dtype: torch.dtype = torch.bfloat16,
+    ):
+        super().__init__()
+        self.register_buffer("weight", weight.detach().to(storage_dtype))
+        self.bias = bias
+
+    def forward(self, x: torch.Tensor) -> torch.Tensor:
+        return torch.ops.qwen.bf16_linear(x, self.weight, self.bias)
+
+
+class Bf16Embedding(torch.nn.Module):
+    """Embedding lookup from a Bf16Linear's table, widened to fp32."""
+
+    def __init__(self, table: Bf16Linear):
+        super().__init__()
+        self.table = table
+
+    def forward(self, input_ids: torch.Tensor) -> torch.Tensor:
+        return torch.ops.qwen.bf16_embedding(input_ids, self.table.weight)
+
+
+class Int8Embedding(torch.nn.Module):
+    """Embedding lookup from an Int8Linear's table, dequantized per row.
+
+    Sharing the table lets a tied lm_head and the embedding keep one int8 copy.
+    """
+
+    def __init__(self, table: Int8Linear, dtype: torch.dtype):
+        super().__init__()
+        self.table = table
+        self.dtype = dtype
+
+    def forward(self, input_ids: torch.Tensor) -> torch.Tensor:
+        flat = input_ids.reshape(-1)
+        rows = self.table.qweight.index_select(0, flat).to(torch.float32)
+        rows = rows * self.table.scale.index_select(0, flat).unsqueeze(-1)
+        return rows.reshape(input_ids.shape + (rows.size(-1),)).to(self.dtype)
+
+
+class VectorLinear(torch.nn.Module):
+    """fp32 nn.Linear computed by qwen::vec_linear (vector GEMV kernels)."""
+
+    def __init__(self, weight: torch.Tensor, bias: torch.Tensor | None):
+        super().__init__()
+        self.weight = weight
+        self.bias = bias
+
+    def forward(self, x: torch.Tensor) -> torch.Tensor:
+        return torch.ops.qwen.vec_linear(x, self.weight, self.bias)
+
+
+class VectorRMSNorm(torch.nn.Module):
+    """Qwen3RMSNorm computed by qwen::rms_norm."""
+
+    def __init__(self, norm: torch.nn.Module):
+        super().__init__()
+        self.weight = norm.weight
+        self.eps = float(norm.variance_epsilon)
+
+    def forward(self, x: torch.Tensor) -> torch.Tensor:
+        return torch.ops.qwen.rms_norm(x, self.weight, self.eps)
+
+
+class VectorMLP(torch.nn.Module):
+    """Qwen3MLP with the SiLU gate and product fused into qwen::silu_mul."""
+
+    def __init__(self, mlp: torch.nn.Module):
+        super().__init__()
+        self.gate_proj = mlp.gate_proj
+        self.up_proj = mlp.up_proj
+        self.down_proj = mlp.down_proj
+
+    def forward(self, x: torch.Tensor) -> torch.Tensor:
+        return self.down_proj(torch.ops.qwen.silu_mul(self.gate_proj(x), self.up_proj(x)))
+
+
+def use_vector_ops(model: torch.nn.Module) -> int:
+    """Routes the fp32 decoder through the qwen:: vector kernel ops.
+
+    Float linears (including an untied or float lm_head) go to
+    qwen::vec_linear, RMSNorms to qwen::rms_norm, the MLP activation to
+    qwen::silu_mul and RoPE to qwen::rope; install_custom_attention handles
+    the attention softmax. Linears already converted by quantize_linears are
+    left alone. Returns the number of replaced modules.
+    """
+    from transformers.models.qwen3 import modeling_qwen3
+
+    def rope(q, k, cos, sin, position_ids=None, unsqueeze_dim=1):
+        return torch.ops.qwen.rope(q, cos, sin), torch.ops.qwen.rope(k, cos, sin)
+
+    modeling_qwen3.apply_rotary_pos_emb = rope
+
+    replaced = 0
+    # Linears first, so the VectorMLPs below pick up the converted projections.
+    for parent in list(model.model.modules()):
+        for name, child in list(parent.named_children()):
+            if isinstance(child, torch.nn.Linear):
+                setattr(parent, name, VectorLinear(child.weight, child.bias))
+                replaced += 1
+    for parent in list(model.model.modules()):
+        for name, child in list(parent.named_children()):
+            if type(child).__name__.endswith("RMSNorm"):
+                setattr(parent, name, VectorRMSNorm(child))
+                replaced += 1
+            elif type(child).__name__.endswith("MLP"):
+                setattr(parent, name, VectorMLP(child))
+                replaced += 1
+    if isinstance(model.lm_head, torch.nn.Linear):
+        model.lm_head = VectorLinear(model.lm_head.weight, model.lm_head.bias)
+        replaced += 1
+    return replaced
+
+
+WEIGHT_FORMATS = ("float", "bf16", "fp16", "int8", "int4")
+EMBEDDING_FORMATS = ("float", "bf16", "fp16", "int8")
+# Formats stored in half precision and widened to fp32 by qwen::bf16_linear.
+HALF_FORMATS = {"bf16": torch.bfloat16, "fp16": torch.float16}
+
+
+def quantize_linears(model: torch.nn.Module, weight_format: str, group_size: int) -> int:
+    """Swaps every nn.Linear in the decoder layers for its weight_format module.
+
+    lm_head is handled by convert_embeddings: Qwen3 ties it to the embedding
+    table, so quantizing it alone would add a second copy instead of shrinking
+    the model.
+    """
+    if weight_format == "float":
+        return 0
+    replaced = 0
+    for parent in model.model.layers.modules():
+        for name, child in list(parent.named_children()):
+            if not isinstance(child, torch.nn.Linear):
+                continue
+            if weight_format in HALF_FORMATS:
+                quantized = Bf16Linear(child.weight, child.bias, HALF_FORMATS[weight_format])
+            elif weight_format == "int8":
+                quantized = Int8Linear(child.weight, child.bias)
+            else:
+                quantized = Int4Linear(child.weight, child.bias, group_size)
+            setattr(parent, name, quantized)
+            replaced += 1
+    return replaced
+
+
+def convert_embeddings(model: torch.nn.Module, embedding_format: str) -> None:
+    """Stores the embedding table and lm_head in embedding_format.
+
+    A tied lm_head shares the converted table with the embedding lookup.
+    """
+    if embedding_format == "float":
+        return
+    embedding = model.model.embed_tokens
+    tied = model.lm_head.weight.data_ptr() == embedding.weight.data_ptr()
+    if embedding_format in HALF_FORMATS:
+        storage_dtype = HALF_FORMATS[embedding_format]
+        table = Bf16Linear(embedding.weight, None, storage_dtype)
+        model.model.embed_tokens = Bf16Embedding(table)
+        head = (
+            table
+            if tied
+            else Bf16Linear(model.lm_head.weight, model.lm_head.bias, storage_dtype)
+        )
+    else:
+        table = Int8Linear(embedding.weight, None)
+        model.model.embed_tokens = Int8Embedding(table, embedding.weight.dtype)
+        head = table if tied else Int8Linear(model.lm_head.weight, model.lm_head.bias)
+    model.lm_head = head
+
+
+def build_cache(
+    past_keys: torch.Tensor | None,
+    past_values: torch.Tensor | None,
+    num_layers: int,
+    kv_cache: str = "float",
+):
+    from transformers.cache_utils import DynamicCache
+
+    cache = DynamicCache()
+    if past_keys is not None and past_values is not None:
+        for layer_idx in range(num_layers):
+            cache.update(past_keys[layer_idx], past_values[layer_idx], layer_idx)
+    if kv_cache == "int8":
+        # The past is already packed; only keys and values written from here
+        # on are quantized.
+        store = cache.update
+
+        def update(key_states, value_states, layer_idx, cache_kwargs=None):
+            return store(
+                torch.ops.qwen.quantize_kv(key_states),
+                torch.ops.qwen.quantize_kv(value_states),
+                layer_idx,
+                cache_kwargs,
+            )
+
+        cache.update = update
+    return cache
+
+
+def paged_example(cache: torch.Tensor, page_tokens: int = 16) -> torch.Tensor:
+    """Copies a [layers, 1, kv_heads, seq, head_dim] cache into consecutive pages."""
+    layers, _, heads, length, dim = cache.shape
+    pages = -(-length // page_tokens)
+    padded = cache.new_zeros(layers, heads, pages * page_tokens, dim)
+    padded[:, :, :length] = cache[:, 0]
+    return padded.reshape(layers, heads, pages, page_tokens, dim).transpose(1, 2).contiguous()
+
+
+def stack_cache(cache, num_layers: int) -> Tuple[torch.Tensor, torch.Tensor]:
+    keys = []
+    values = []
+    for layer_idx in range(num_layers):
+        key, value = cache[layer_idx]
+        keys.append(key)
+        values.append(value)
+    return torch.stack(keys), torch.stack(values)
+
+
 class CausalLMForwardWrapper(torch.nn.Module):
-    def __init__(self, model: torch.nn.Module):
+    """Prefill and decode entry points over a stacked KV cache.
+
+    Caches are [num_layers, batch, kv_heads, seq_len, head_dim]. prefill runs the
+    prompt and returns the cache it produced; decode_step appends one token per
+    row to an existing cache. attention_mask always spans the full cached length
+    plus the new tokens, so left-padded rows stay masked.
+
+    prefill_with_past runs several new tokens per row over an existing cache in
+    one forward, e.g. the rest of a prompt whose prefix cache was reused; it
+    takes decode_step's arguments with [batch, new_tokens] tokens and
+    position_ids.
+
+    prefill_int8_kv, decode_step_int8_kv and prefill_with_past_int8_kv are the
+    same entry points over an int8 cache: every key/value vector is stored as
+    head_dim int8 values plus its fp32 scale (qwen::quantize_kv), i.e.
+    [..., seq_len, head_dim + 4], and attention dequantizes inside
+    qwen::int8_kv_attention.
+
+    decode_step_paged reads the past from a page pool instead: key_pages and
+    value_pages are [num_layers, pages, kv_heads, page_tokens, head_dim],
+    block_tables [batch, max_pages] lists each row's pages and context_lens
+    [batch] its cached length. It returns only the new token's keys/values;
+    the caller writes them into the pool.
+
+    logits_to_keep > 0 slices the final hidden states to the last N positions
+    before lm_head, so prefill never materializes [batch, seq, vocab] logits;
+    0 keeps every position. With head="argmax" the first output holds greedy
+    token ids from qwen::lm_head_argmax instead of logits.
+    """
+
+    def __init__(self, model: torch.nn.Module, logits_to_keep: int = 1, head: str = "logits"):
         super().__init__()
         self.model = model
-
-    def forward(self, input_ids: torch.Tensor, attention_mask: torch.Tensor) -> torch.Tensor:
-        outputs = self.model(
+        self.num_layers = model.config.num_hidden_layers
+        self.logits_to_keep = logits_to_keep
+        self.head = head
+
+    def _run(
+        self,
+        input_ids: torch.Tensor,
+        attention_mask: torch.Tensor,
+        cache,
+        position_ids: torch.Tensor,
+        cache_position: torch.Tensor,
+        **attention_kwargs,
+    ) -> Tuple[torch.Tensor, torch.Tensor, torch.Tensor]:
+        outputs = self.model.model(
             input_ids=input_ids,
             attention_mask=attention_mask,
-            use_cache=False,
+            past_key_values=cache,
+            position_ids=position_ids,
+            cache_position=cache_position,
+            use_cache=True,
             return_dict=False,
+            **attention_kwargs,
+        )
+        hidden_states = outputs[0]
+        if self.logits_to_keep > 0:
+            hidden_states = hidden_states[:, -self.logits_to_keep :, :]
+        if self.head == "argmax":
+            logits = torch.ops.qwen.lm_head_argmax(hidden_states, self.model.lm_head.weight)
+        else:
+            logits = self.model.lm_head(hidden_states)
+        keys, values = stack_cache(outputs[1], self.num_layers)
+        return logits, keys, values
+
+    def _prefill(
+        self, input_ids: torch.Tensor, attention_mask: torch.Tensor, kv_cache: str
+    ) -> Tuple[torch.Tensor, torch.Tensor, torch.Tensor]:
+        position_ids = attention_mask.long().cumsum(-1) - 1
+        position_ids = position_ids.masked_fill(attention_mask == 0, 1)
+        cache_position = torch.arange(input_ids.size(1), device=input_ids.device)
+        return self._run(
+            input_ids,
+            attention_mask,
+            build_cache(None, None, self.num_layers, kv_cache),
+            position_ids,
+            cache_position,
+        )
+
+    def _decode_step(
+        self,
+        token: torch.Tensor,
+        past_keys: torch.Tensor,
+        past_values: torch.Tensor,
+        attention_mask: torch.Tensor,
+        position_ids: torch.Tensor,
+        kv_cache: str,
+    ) -> Tuple[torch.Tensor, torch.Tensor, torch.Tensor]:
+        past_length = past_keys.size(-2)
+        cache_position = torch.arange(
+            past_length, past_length + token.size(1), device=token.device
+        )
+        return self._run(
+            token,
+            attention_mask,
+            build_cache(past_keys, past_values, self.num_layers, kv_cache),
+            position_ids,
+            cache_position,
+        )
+
+    def prefill(
+        self, input_ids: torch.Tensor, attention_mask: torch.Tensor
+    ) -> Tuple[torch.Tensor, torch.Tensor, torch.Tensor]:
+        return self._prefill(input_ids, attention_mask, "float")
+
+    def decode_step(
+        self,
+        token: torch.Tensor,
+        past_keys: torch.Tensor,
+        past_values: torch.Tensor,
+        attention_mask: torch.Tensor,
+        position_ids: torch.Tensor,
+    ) -> Tuple[torch.Tensor, torch.Tensor, torch.Tensor]:
+        return self._decode_step(
+            token, past_keys, past_values, attention_mask, position_ids, "float"
+        )
+
+    def prefill_with_past(
+        self,
+        tokens: torch.Tensor,
+        past_keys: torch.Tensor,
+        past_values: torch.Tensor,
+        attention_mask: torch.Tensor,
+        position_ids: torch.Tensor,
+    ) -> Tuple[torch.Tensor, torch.Tensor, torch.Tensor]:
+        return self._decode_step(
+            tokens, past_keys, past_values, attention_mask, position_ids, "float"
+        )
+
+    def prefill_int8_kv(
+        self, input_ids: torch.Tensor, attention_mask: torch.Tensor
+    ) -> Tuple[torch.Tensor, torch.Tensor, torch.Tensor]:
+        return self._prefill(input_ids, attention_mask, "int8")
+
+    def prefill_with_past_int8_kv(
+        self,
+        tokens: torch.Tensor,
+        past_keys: torch.Tensor,
+        past_values: torch.Tensor,
+        attention_mask: torch.Tensor,
+        position_ids: torch.Tensor,
+    ) -> Tuple[torch.Tensor, torch.Tensor, torch.Tensor]:
+        return self._decode_step(
+            tokens, past_keys, past_values, attention_mask, position_ids, "int8"
+        )
+
+    def decode_step_int8_kv(
+        self,
+        token: torch.Tensor,
+        past_keys: torch.Tensor,
+        past_values: torch.Tensor,
+        attention_mask: torch.Tensor,
+        position_ids: torch.Tensor,
+    ) -> Tuple[torch.Tensor, torch.Tensor, torch.Tensor]:
+        return self._decode_step(
+            token, past_keys, past_values, attention_mask, position_ids, "int8"
+        )
+
+    def decode_step_paged(
+        self,
+        token: torch.Tensor,
+        key_pages: torch.Tensor,
+        value_pages: torch.Tensor,
+        block_tables: torch.Tensor,
+        context_lens: torch.Tensor,
+        position_ids: torch.Tensor,
+    ) -> Tuple[torch.Tensor, torch.Tensor, torch.Tensor]:
+        # The cache here only collects the new token's keys/values; attention
+        # reads the past through paged_kv, so no padding mask is needed.
+        return self._run(
+            token,
+            None,
+            build_cache(None, None, self.num_layers),
+            position_ids,
+            torch.arange(token.size(1), device=token.device),
+            paged_kv=(key_pages, value_pages, block_tables, context_lens),
         )
-        return outputs[0]
 
 
-def export_model(model_dir: Path, output_path: Path, prompt: str, dtype_str: str, enable_thinking: bool) -> None:
+def export_config(
+    config,
+    dtype: torch.dtype,
+    logits_to_keep: int,
+    head: str,
+    weight_format: str,
+    group_size: int,
+    embeddings: str,
+    kv_caches: Tuple[str, ...],
+    paged_kv: bool,
+    vector_ops: bool,
+) -> str:
+    head_dim = getattr(config, "head_dim", None) or config.hidden_size // config.num_attention_heads
+    entries = {
+        "interface": "prefill_decode",
+        "prefill_with_past": 1,
+        "num_layers": config.num_hidden_layers,
+        "num_kv_heads": config.num_key_value_heads,
+        "head_dim": head_dim,
+        "vocab_size": config.vocab_size,
+        "dtype": str(dtype).replace("torch.", ""),
+        "logits_to_keep": logits_to_keep,
+        "head": head,
+        "weight_format": weight_format,
+        "embeddings": embeddings,
+        "kv_cache": ",".join(kv_caches),
+        "paged_kv": int(paged_kv),
+        "vector_ops": int(vector_ops),
+    }
+    if weight_format == "int4":
+        entries["group_size"] = group_size
+    return "".join(f"{key}={value}\n" for key, value in entries.items())
+
+
+def export_model(
+    model_dir: Path,
+    output_path: Path,
+    prompt: str,
+    dtype_str: str,
+    enable_thinking: bool,
+    logits_to_keep: int,
+    head: str,
+    weight_format: str,
+    group_size: int,
+    embedding_format: str,
+    int8_kv_cache: bool,
+    paged_kv: bool,
+    vector_ops: bool,
+) -> None:
     device = torch.device("cpu")
     dtype = resolve_dtype(dtype_str)
+    if logits_to_keep < 0:
+        raise ValueError(f"--logits-to-keep must be >= 0, got {logits_to_keep}")
+    if embedding_format == "int8" and head == "argmax":
+        raise ValueError(
+            "--embedding-format int8 needs a float lm_head and cannot be used with --head argmax"
+        )
+    if vector_ops and dtype != torch.float32:
+        raise ValueError("--vector-ops needs --dtype float32")
 
     install_torchscript_friendly_mask()
+    kv_caches = ("float", "int8") if int8_kv_cache else ("float",)
+    install_custom_attention(vector_ops)
 
     tokenizer = AutoTokenizer.from_pretrained(
         model_dir,
@@ -263,19 +837,100 @@ def export_model(model_dir: Path, output_path: Path, prompt: str, dtype_str: str
         )
     model.to(device)
     model.eval()
-
-    wrapper = CausalLMForwardWrapper(model)
+    quantize_linears(model, weight_format, group_size)
+    convert_embeddings(model, embedding_format)
+    if vector_ops:
+        use_vector_ops(model)
+    embeddings = embedding_format
+    if embedding_format == "float":
+        embeddings = str(dtype).replace("torch.", "")
+
+    wrapper = CausalLMForwardWrapper(model, logits_to_keep, head)
     wrapper.eval()
 
     inputs = prepare_inputs(tokenizer, prompt, device, enable_thinking)
-    example_inputs = (inputs["input_ids"], inputs["attention_mask"])
+    input_ids = inputs["input_ids"]
+    attention_mask = inputs["attention_mask"]
 
-    with torch.inference_mode():
-        scripted = torch.jit.trace(wrapper, example_inputs, strict=False)
-        scripted = torch.jit.freeze(scripted)
+    if input_ids.size(1) < 2:
+        raise ValueError("--prompt must encode to at least 2 tokens")
 
+    with torch.inference_mode():
+        # Each entry point is traced with an input of its own shape regime:
+        # the full prompt for prefill, one token over a warm cache for decode,
+        # and the prompt's second half over its first half's cache for
+        # prefill_with_past.
+        logits, past_keys, past_values = wrapper.prefill(input_ids, attention_mask)
+        if head == "argmax":
+            token = logits[:, -1:]
+        else:
+            token = logits[:, -1].argmax(-1, keepdim=True)
+        decode_mask = torch.cat([attention_mask, torch.ones_like(token)], dim=1)
+        position_ids = torch.full_like(token, input_ids.size(1))
+        split = input_ids.size(1) // 2
+        suffix = input_ids[:, split:]
+        suffix_positions = torch.arange(split, input_ids.size(1)).unsqueeze(0)
+        _, head_keys, head_values = wrapper.prefill(
+            input_ids[:, :split], attention_mask[:, :split]
+        )
+        methods = {
+            "prefill": (input_ids, attention_mask),
+            "decode_step": (token, past_keys, past_values, decode_mask, position_ids),
+            "prefill_with_past": (
+                suffix,
+                head_keys,
+                head_values,
+                attention_mask,
+                suffix_positions,
+            ),
+        }
+        if int8_kv_cache:
+            _, int8_keys, int8_values = wrapper.prefill_int8_kv(input_ids, attention_mask)
+            _, int8_head_keys, int8_head_values = wrapper.prefill_int8_kv(
+                input_ids[:, :split], attention_mask[:, :split]
+            )
+            methods["prefill_int8_kv"] = (input_ids, attention_mask)
+            methods["decode_step_int8_kv"] = (
+                token,
+                int8_keys,
+                int8_values,
+                decode_mask,
+                position_ids,
+            )
+            methods["prefill_with_past_int8_kv"] = (
+                suffix,
+                int8_head_keys,
+                int8_head_values,
+                attention_mask,
+                suffix_positions,
+            )
+        if paged_kv:
+            past_length = past_keys.size(-2)
+            methods["decode_step_paged"] = (
+                token,
+                paged_example(past_keys),
+                paged_example(past_values),
+                torch.arange(-(-past_length // 16)).unsqueeze(0),
+                torch.tensor([past_length]),
+                position_ids,
+            )
+        scripted = torch.jit.trace_module(wrapper, methods, strict=False)
+        scripted = torch.jit.freeze(scripted, preserved_attrs=list(methods))
+
+    config_text = export_config(
+        model.config,
+        dtype,
+        logits_to_keep,
+        head,
+        weight_format,
+        group_size,
+        embeddings,
+        kv_caches,
+        paged_kv,
+        vector_ops,
+    )
     output_path.parent.mkdir(parents=True, exist_ok=True)
-    torch.jit.save(scripted, output_path)
+    torch.jit.save(scripted, output_path, _extra_files={EXPORT_CONFIG_NAME: config_text})
 
 
 if __name__ == "__main__":
@@ -286,7 +941,77 @@ if __name__ == "__main__":
     parser.add_argument("--dtype", type=str, default="float32")
     parser.add_argument("--enable-thinking", action="store_true")
     parser.add_argument("--disable-thinking", action="store_false", dest="enable_thinking")
+    parser.add_argument(
+        "--logits-to-keep",
+        type=int,
+        default=1,
+        help="Compute lm_head only for the last N positions (0 keeps all positions)",
+    )
+    parser.add_argument(
+        "--head",
+        choices=["logits", "argmax"],
+        default="logits",
+        help="'argmax' fuses lm_head with greedy selection (qwen::lm_head_argmax); "
+        "the exported module then returns token ids and only supports greedy decoding",
+    )
+    parser.add_argument(
+        "--weight-format",
+        choices=WEIGHT_FORMATS,
+        default="float",
+        help="Storage format for the decoder linear weights: 'int8' is per-output-channel "
+        "(qwen::int8_linear), 'int4' is group-wise with fp16 scales and zero-points "
+        "(qwen::int4_linear), 'bf16'/'fp16' store half precision and compute in fp32 "
+        "(qwen::bf16_linear)",
+    )
+    parser.add_argument(
+        "--group-size",
+        type=int,
+        default=128,
+        help="Input columns per scale/zero-point group for --weight-format int4",
+    )
+    parser.add_argument(
+        "--embedding-format",
+        choices=EMBEDDING_FORMATS,
+        default="float",
+        help="Storage format for the embedding table and lm_head (shared when tied); "
+        "'bf16'/'fp16' widen to fp32 inside qwen::bf16_embedding / qwen::bf16_linear",
+    )
+    parser.add_argument(
+        "--int8-kv-cache",
+        action=argparse.BooleanOptionalAction,
+        default=True,
+        help="Also export prefill_int8_kv/decode_step_int8_kv, which keep the KV cache as "
+        "int8 with per-head, per-token scales (qwen3_infer --kv-cache int8)",
+    )
+    parser.add_argument(
+        "--paged-kv",
+        action=argparse.BooleanOptionalAction,
+        default=True,
+        help="Also export decode_step_paged, which reads the KV cache through per-sequence "
+        "block tables (qwen3_infer --kv-pages)",
+    )
+    parser.add_argument(
+        "--vector-ops",
+        action="store_true",
+        help="Run fp32 linears, RMSNorm, SiLU-gated MLP, RoPE and the attention softmax "
+        "through the qwen:: vector kernels; qwen3_infer picks their scalar or RVV table "
+        "at startup for the CPU it runs on",
+    )
     parser.set_defaults(enable_thinking=True)
 
     args = parser.parse_args()
-    export_model(args.model_dir, args.output, args.prompt, args.dtype, args.enable_thinking)
+    export_model(
+        args.model_dir,
+        args.output,
+        args.prompt,
+        args.dtype,
+        args.enable_thinking,
+        args.logits_to_keep,
+        args.head,
+        args.weight_format,
+        args.group_size,
+        args.embedding_format,
+        args.int8_kv_cache,
+        args.paged_kv,
+        args.vector_ops,
+    )
@@ -0,0 +1,98 @@
+#include "generation.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace qwen3 {
+
+GenerationState::GenerationState(const std::vector<int64_t>& prompt, int64_t max_new_tokens)
+    : capacity_(static_cast<int64_t>(prompt.size()) + std::max<int64_t>(max_new_tokens, 0)),
+      length_(static_cast<int64_t>(prompt.size())),
+      tokens_(torch::empty({1, capacity_}, torch::kLong)),
+      attention_mask_(torch::ones({1, capacity_}, torch::kLong)) {
+  std::copy(prompt.begin(), prompt.end(), tokens_.data_ptr<int64_t>());
+}
+
+void GenerationState::append(int64_t token) {
+  TORCH_CHECK(length_ < capacity_, "generation buffer is full (capacity ", capacity_, ")");
+  tokens_.data_ptr<int64_t>()[length_++] = token;
+}
+
+std::vector<int64_t> GenerationState::to_vector() const {
+  const int64_t* data = tokens_.data_ptr<int64_t>();
+  return std::vector<int64_t>(data, data + length_);
+}
+
+void check_sampling_supported(const ExportConfig& config, const SamplingConfig& sampling) {
+  if (config.argmax_head && !sampling.plain_argmax()) {
+    throw std::runtime_error(
+        "Model was exported with an argmax head; sampling options require --head logits");
+  }
+}
+
+int64_t select_token(const ExportConfig& config,
+                     const SamplingConfig& sampling,
+                     Sampler& sampler,
+                     const torch::Tensor& row,
+                     const torch::Tensor& history) {
+  if (config.argmax_head) {
+    return row.item<int64_t>();
+  }
+  if (sampling.plain_argmax()) {
+    return row.argmax().item<int64_t>();
+  }
+  const torch::Tensor contiguous_history = history.contiguous();
+  return sampler.sample(row, contiguous_history.data_ptr<int64_t>(), contiguous_history.numel());
+}
+
+std::vector<int64_t> generate(Qwen3Model& model,
+                              const std::vector<int64_t>& prompt,
+                              const GenerationOptions& options,
+                              const TokenCallback& on_token) {
+  torch::NoGradGuard no_grad;
+  const ExportConfig& config = model.config();
+  check_sampling_supported(config, options.sampling);
+  check_kv_cache_supported(config, options.kv_cache);
+  Sampler sampler(options.sampling);
+  GenerationState generation(prompt, options.max_new_tokens);
+  if (options.max_new_tokens <= 0) {
+    return generation.to_vector();
+  }
+
+  // Prefill runs the prompt once and decode_step feeds only the newest token;
+  // legacy archives re-run forward() over the whole sequence every step.
+  StepOutput state;
+  if (config.prefill_decode) {
+    state = options.prefix_cache
+        ? prefill_with_prefix_cache(model, prompt, options.kv_cache, *options.prefix_cache)
+        : model.prefill(generation.tokens(), generation.attention_mask(), options.kv_cache);
+  } else {
+    state.logits = model.forward(generation.tokens(), generation.attention_mask());
+  }
+
+  for (int step = 0; step < options.max_new_tokens; ++step) {
+    const int64_t next_token = select_token(
+        config, options.sampling, sampler, state.logits.index({0, -1}), generation.tokens());
+
+    generation.append(next_token);
+    if (on_token) {
+      on_token(next_token);
+    }
+    if ((options.eos_token >= 0 && next_token == options.eos_token) ||
+        step + 1 == options.max_new_tokens) {
+      break;
+    }
+
+    if (config.prefill_decode) {
+      state = model.decode_step(generation.last_token(),
+                                state,
+                                generation.attention_mask(),
+                                torch::full({1, 1}, generation.length() - 1, torch::kLong));
+    } else {
+      state.logits = model.forward(generation.tokens(), generation.attention_mask());
+    }
+  }
+  return generation.to_vector();
+}
+
+}  // namespace qwen3
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <torch/script.h>
+
+#include "model.h"
+#include "prefix_cache.h"
+#include "sampler.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace qwen3 {
+
+struct GenerationOptions {
+  int max_new_tokens = 64;
+  int64_t eos_token = -1;
+  SamplingConfig sampling;
+  KvCacheDtype kv_cache = KvCacheDtype::kFloat;
+  // > 0 keeps batched sequences in a paged KV cache with this many pages
+  // (paged_kv_cache.h) instead of padded per-batch tensors.
+  int64_t kv_pages = 0;
+  // Single-prompt prefills (generate() and the server) resume from and add to
+  // this cache when set.
+  std::shared_ptr<const PrefixCache> prefix_cache;
+};
+
+// Token ids and attention mask for one sequence, allocated once at
+// [1, prompt_len + max_new_tokens]. Each step sees narrowed views of the
+// filled prefix, so growing the sequence never reallocates or copies.
+class GenerationState {
+ public:
+  GenerationState(const std::vector<int64_t>& prompt, int64_t max_new_tokens);
+
+  void append(int64_t token);
+
+  int64_t length() const { return length_; }
+  torch::Tensor tokens() const { return tokens_.narrow(1, 0, length_); }
+  torch::Tensor last_token() const { return tokens_.narrow(1, length_ - 1, 1); }
+  torch::Tensor attention_mask() const { return attention_mask_.narrow(1, 0, length_); }
+
+  std::vector<int64_t> to_vector() const;
+
+ private:
+  int64_t capacity_;
+  int64_t length_;
+  torch::Tensor tokens_;
+  torch::Tensor attention_mask_;
+};
+
+// Invoked with each generated token as soon as it has been selected.
+using TokenCallback = std::function<void(int64_t)>;
+
+// Throws if the model's head cannot honour the requested sampling policy.
+void check_sampling_supported(const ExportConfig& config, const SamplingConfig& sampling);
+
+// Picks the next token from one row of model output (logits, or a token id
+// for an argmax head). history is the sequence so far.
+int64_t select_token(const ExportConfig& config,
+                     const SamplingConfig& sampling,
+                     Sampler& sampler,
+                     const torch::Tensor& row,
+                     const torch::Tensor& history);
+
+// Runs prefill and decode for one prompt and returns the prompt followed by
+// the generated tokens.
+std::vector<int64_t> generate(Qwen3Model& model,
+                              const std::vector<int64_t>& prompt,
+                              const GenerationOptions& options,
+                              const TokenCallback& on_token = nullptr);
+
+}  // namespace qwen3
@@ -0,0 +1,132 @@
+#include "gzip_reader.h"
+
+#include <c10/util/Exception.h>
+
+#ifdef QWEN3_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace qwen3 {
+namespace {
+// Inflate in 64 MB steps; the gzip trailer only records the size modulo 4 GB,
+// so it is used as the first allocation rather than trusted.
+constexpr size_t kInflateChunk = size_t{64} << 20;
+
+size_t page_size() {
+  static const size_t size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  return size;
+}
+
+uintptr_t page_of(const char* address) {
+  return reinterpret_cast<uintptr_t>(address) / page_size();
+}
+
+size_t uncompressed_size_hint(const std::string& path) {
+  std::ifstream stream(path, std::ios::binary | std::ios::ate);
+  if (!stream || stream.tellg() < 4) {
+    return 0;
+  }
+  stream.seekg(-4, std::ios::end);
+  unsigned char trailer[4] = {};
+  stream.read(reinterpret_cast<char*>(trailer), sizeof(trailer));
+  return static_cast<size_t>(trailer[0]) | static_cast<size_t>(trailer[1]) << 8 |
+         static_cast<size_t>(trailer[2]) << 16 | static_cast<size_t>(trailer[3]) << 24;
+}
+}  // namespace
+
+bool is_gzip_file(const std::string& path) {
+  std::ifstream stream(path, std::ios::binary);
+  unsigned char magic[2] = {};
+  return stream.read(reinterpret_cast<char*>(magic), sizeof(magic)) && magic[0] == 0x1f &&
+         magic[1] == 0x8b;
+}
+
+#ifdef QWEN3_HAVE_ZLIB
+GzipReadAdapter::GzipReadAdapter(const std::string& path) {
+  gzFile file = gzopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    throw std::runtime_error("Failed to open gzip model: " + path);
+  }
+  gzbuffer(file, 1 << 20);
+
+  // realloc leaves new bytes uninitialized, so no page is touched before
+  // inflate writes it, and glibc grows large blocks with mremap.
+  size_t capacity = 0;
+  auto grow = [&](size_t wanted) {
+    void* grown = std::realloc(data_.get(), wanted);
+    if (grown == nullptr) {
+      gzclose(file);
+      throw std::runtime_error("Out of memory inflating " + path);
+    }
+    data_.release();
+    data_.reset(static_cast<char*>(grown));
+    capacity = wanted;
+  };
+  grow(std::max(uncompressed_size_hint(path), kInflateChunk));
+
+  size_t filled = 0;
+  while (true) {
+    if (capacity - filled < kInflateChunk) {
+      grow(filled + kInflateChunk);
+    }
+    const int n = gzread(file, data_.get() + filled, static_cast<unsigned>(kInflateChunk));
+    if (n < 0) {
+      int errnum = 0;
+      const std::string message = gzerror(file, &errnum);
+      gzclose(file);
+      throw std::runtime_error("Failed to decompress " + path + ": " + message);
+    }
+    if (n == 0) {
+      break;
+    }
+    filled += static_cast<size_t>(n);
+  }
+  gzclose(file);
+  // At most one chunk of slack past the archive; it is never touched, so it
+  // costs address space rather than memory.
+  size_ = filled;
+  released_.assign(page_of(data_.get() + size_) - page_of(data_.get()) + 1, false);
+}
+#else
+GzipReadAdapter::GzipReadAdapter(const std::string& path) {
+  throw std::runtime_error("qwen3_infer was built without zlib and cannot load " + path +
+                           "; decompress it with gzip -d first");
+}
+#endif
+
+size_t GzipReadAdapter::read(uint64_t pos, void* buf, size_t n, const char* what) const {
+  TORCH_CHECK(pos <= size_, "GzipReadAdapter: ", what, " read at ", pos,
+              " is past the end of the ", size_, "-byte archive");
+  const size_t count = std::min<size_t>(n, size_ - pos);
+  const char* begin = data_.get() + pos;
+  const uintptr_t base = page_of(data_.get());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (uintptr_t page = page_of(begin); count > 0 && page <= page_of(begin + count - 1); ++page) {
+    TORCH_CHECK(!released_[page - base], "GzipReadAdapter: ", what, " read at ", pos,
+                " re-reads a record that was already loaded and released; decompress the "
+                "archive with gzip -d and load the .ts instead");
+  }
+  std::memcpy(buf, begin, count);
+
+  // Only pages lying wholly inside this read are released; the ones it shares
+  // with neighbouring records (zip headers, small records) stay.
+  const uintptr_t first = page_of(begin + page_size() - 1);
+  const uintptr_t last = page_of(begin + count);
+  if (last > first &&
+      ::madvise(reinterpret_cast<void*>(first * page_size()), (last - first) * page_size(),
+                MADV_DONTNEED) == 0) {
+    std::fill(released_.begin() + (first - base), released_.begin() + (last - base), true);
+  }
+  return count;
+}
+
+}  // namespace qwen3
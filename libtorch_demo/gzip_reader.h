@@ -0,0 +1,40 @@
+#pragma once
+
+#include <caffe2/serialize/read_adapter_interface.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace qwen3 {
+
+// True if the file starts with the gzip magic bytes.
+bool is_gzip_file(const std::string& path);
+
+// Serves a gzip-compressed TorchScript archive to torch::jit::load. The zip
+// reader needs random access, so the archive is inflated once into memory.
+// torch::jit::load reads every tensor record exactly once, into a storage it
+// keeps, so the whole pages of each large read are handed back to the system
+// as soon as they are copied out: the inflated archive and the loaded weights
+// are never resident together and peak memory stays about 1x the model. A
+// later read of a released page throws instead of returning zeros.
+class GzipReadAdapter : public caffe2::serialize::ReadAdapterInterface {
+ public:
+  explicit GzipReadAdapter(const std::string& path);
+
+  size_t size() const override { return size_; }
+  size_t read(uint64_t pos, void* buf, size_t n, const char* what = "") const override;
+
+ private:
+  // malloc'd so growing it neither zero-fills nor (for large blocks) copies.
+  std::unique_ptr<char, decltype(&std::free)> data_{nullptr, &std::free};
+  size_t size_ = 0;
+  mutable std::mutex mutex_;
+  // One flag per page of data_, set once the page has been released.
+  mutable std::vector<bool> released_;
+};
+
+}  // namespace qwen3
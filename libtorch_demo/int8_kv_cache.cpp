@@ -0,0 +1,168 @@
+#include "int8_kv_cache.h"
+
+#include <ATen/Parallel.h>
+#include <torch/library.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace qwen3 {
+namespace {
+// Cache rows quantized per task; each row is only head_dim values.
+constexpr int64_t kQuantizeGrain = 64;
+
+float row_scale(const int8_t* row, int64_t head_dim) {
+  float scale;
+  std::memcpy(&scale, row + head_dim, sizeof(scale));
+  return scale;
+}
+}  // namespace
+
+at::Tensor quantize_kv(const at::Tensor& input) {
+  TORCH_CHECK(input.dim() >= 1 && input.size(-1) > 0,
+              "quantize_kv: input must have a non-empty last dimension");
+  const int64_t width = input.size(-1);
+  const int64_t packed_width = width + kKvScaleBytes;
+  const at::Tensor rows = input.reshape({-1, width}).to(at::kFloat).contiguous();
+  const int64_t count = rows.size(0);
+  at::Tensor out = at::empty({count, packed_width}, input.options().dtype(at::kChar));
+
+  const float* x = rows.data_ptr<float>();
+  int8_t* y = out.data_ptr<int8_t>();
+  at::parallel_for(0, count, kQuantizeGrain, [&](int64_t begin, int64_t end) {
+    for (int64_t r = begin; r < end; ++r) {
+      const float* xr = x + r * width;
+      int8_t* yr = y + r * packed_width;
+      float max_abs = 0.0f;
+      for (int64_t k = 0; k < width; ++k) {
+        max_abs = std::max(max_abs, std::fabs(xr[k]));
+      }
+      const float scale = max_abs / 127.0f;
+      const float inverse = scale > 0.0f ? 1.0f / scale : 0.0f;
+      for (int64_t k = 0; k < width; ++k) {
+        yr[k] = static_cast<int8_t>(std::clamp(std::nearbyint(xr[k] * inverse), -127.0f, 127.0f));
+      }
+      std::memcpy(yr + width, &scale, sizeof(scale));
+    }
+  });
+
+  std::vector<int64_t> out_shape(input.sizes().begin(), input.sizes().end());
+  out_shape.back() = packed_width;
+  return out.reshape(out_shape);
+}
+
+at::Tensor int8_kv_attention(const at::Tensor& query,
+                             const at::Tensor& key,
+                             const at::Tensor& value,
+                             const c10::optional<at::Tensor>& attention_mask,
+                             double scaling) {
+  TORCH_CHECK(query.dim() == 4, "int8_kv_attention: query must be 4-D, got ", query.dim(), "-D");
+  TORCH_CHECK(key.dim() == 4 && key.scalar_type() == at::kChar &&
+                  value.scalar_type() == at::kChar && key.sizes() == value.sizes(),
+              "int8_kv_attention: key and value must be matching packed int8 caches");
+  const int64_t batch = query.size(0);
+  const int64_t heads = query.size(1);
+  const int64_t q_len = query.size(2);
+  const int64_t head_dim = query.size(3);
+  const int64_t kv_heads = key.size(1);
+  const int64_t kv_len = key.size(2);
+  const int64_t row_bytes = head_dim + kKvScaleBytes;
+  TORCH_CHECK(key.size(0) == batch, "int8_kv_attention: cache batch ", key.size(0),
+              " does not match query batch ", batch);
+  TORCH_CHECK(key.size(3) == row_bytes, "int8_kv_attention: packed rows are ", key.size(3),
+              " bytes, expected head_dim + ", kKvScaleBytes, " = ", row_bytes);
+  TORCH_CHECK(kv_heads > 0 && heads % kv_heads == 0, "int8_kv_attention: ", heads,
+              " query heads cannot share ", kv_heads, " KV heads");
+  TORCH_CHECK(kv_len > 0, "int8_kv_attention: empty KV cache");
+  const int64_t group = heads / kv_heads;
+
+  const at::Tensor q = query.to(at::kFloat).contiguous();
+  const at::Tensor k = key.contiguous();
+  const at::Tensor v = value.contiguous();
+  // Broadcast dimensions of the mask keep stride 0, so it is never expanded
+  // in memory.
+  at::Tensor mask;
+  if (attention_mask.has_value() && attention_mask->defined()) {
+    mask = attention_mask->to(at::kFloat).expand({batch, heads, q_len, kv_len});
+  }
+  at::Tensor out = at::empty({batch, heads, q_len, head_dim}, q.options());
+
+  const float* qp = q.data_ptr<float>();
+  const int8_t* kp = k.data_ptr<int8_t>();
+  const int8_t* vp = v.data_ptr<int8_t>();
+  const float* mp = mask.defined() ? mask.data_ptr<float>() : nullptr;
+  float* op = out.data_ptr<float>();
+  const float scale = static_cast<float>(scaling);
+  at::parallel_for(0, batch * heads * q_len, 1, [&](int64_t begin, int64_t end) {
+    std::vector<float> scores(static_cast<size_t>(kv_len));
+    std::vector<float> acc(static_cast<size_t>(head_dim));
+    for (int64_t task = begin; task < end; ++task) {
+      const int64_t qi = task % q_len;
+      const int64_t h = (task / q_len) % heads;
+      const int64_t b = task / (q_len * heads);
+      const float* qrow = qp + task * head_dim;
+      const int64_t cache_offset = (b * kv_heads + h / group) * kv_len * row_bytes;
+      const int8_t* keys = kp + cache_offset;
+      const int8_t* values = vp + cache_offset;
+      const float* mrow = mp != nullptr
+          ? mp + b * mask.stride(0) + h * mask.stride(1) + qi * mask.stride(2)
+          : nullptr;
+
+      float max_score = -std::numeric_limits<float>::infinity();
+      for (int64_t j = 0; j < kv_len; ++j) {
+        const int8_t* kr = keys + j * row_bytes;
+        float dot = 0.0f;
+        for (int64_t d = 0; d < head_dim; ++d) {
+          dot += qrow[d] * static_cast<float>(kr[d]);
+        }
+        float score = dot * row_scale(kr, head_dim) * scale;
+        if (mrow != nullptr) {
+          score += mrow[j * mask.stride(3)];
+        }
+        scores[j] = score;
+        max_score = std::max(max_score, score);
+      }
+
+      float sum = 0.0f;
+      for (int64_t j = 0; j < kv_len; ++j) {
+        scores[j] = std::exp(scores[j] - max_score);
+        sum += scores[j];
+      }
+      std::fill(acc.begin(), acc.end(), 0.0f);
+      for (int64_t j = 0; j < kv_len; ++j) {
+        const int8_t* vr = values + j * row_bytes;
+        // Fold the value row's scale into its attention weight.
+        const float weight = scores[j] * row_scale(vr, head_dim);
+        if (weight == 0.0f) {
+          continue;
+        }
+        for (int64_t d = 0; d < head_dim; ++d) {
+          acc[d] += weight * static_cast<float>(vr[d]);
+        }
+      }
+      float* dst = op + task * head_dim;
+      const float inverse_sum = 1.0f / sum;
+      for (int64_t d = 0; d < head_dim; ++d) {
+        dst[d] = acc[d] * inverse_sum;
+      }
+    }
+  });
+  return out.to(query.scalar_type());
+}
+
+}  // namespace qwen3
+
+TORCH_LIBRARY_FRAGMENT(qwen, m) {
+  m.def("quantize_kv(Tensor input) -> Tensor");
+  m.def(
+      "int8_kv_attention(Tensor query, Tensor key, Tensor value, Tensor? attention_mask, "
+      "float scaling) -> Tensor");
+}
+
+TORCH_LIBRARY_IMPL(qwen, CPU, m) {
+  m.impl("quantize_kv", &qwen3::quantize_kv);
+  m.impl("int8_kv_attention", &qwen3::int8_kv_attention);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <ATen/ATen.h>
+
+#include <c10/util/Optional.h>
+
+namespace qwen3 {
+
+// Int8 KV cache rows carry their own scale: each [head_dim] key or value
+// vector is stored as head_dim int8 values followed by the 4 bytes of its fp32
+// scale, so a packed cache is int8 [..., seq, head_dim + 4]. The cache keeps
+// one tensor per K and V and can be padded, concatenated and sliced along the
+// batch and sequence dimensions like the float cache.
+constexpr int64_t kKvScaleBytes = sizeof(float);
+
+// Quantizes [..., head_dim] keys or values symmetrically with one scale per
+// vector (per head and token): q = round(x / scale), scale = max|x| / 127.
+// Returns the packed int8 [..., head_dim + 4] layout. Registered for
+// TorchScript as qwen::quantize_kv.
+at::Tensor quantize_kv(const at::Tensor& input);
+
+// softmax(query @ K.T * scaling + attention_mask) @ V over a packed int8
+// cache, dequantizing inside the dot products. query is [batch, heads, q_len,
+// head_dim]; key and value are packed [batch, kv_heads, kv_len, head_dim + 4]
+// with heads a multiple of kv_heads (grouped-query attention). attention_mask
+// is additive and broadcastable to [batch, heads, q_len, kv_len]. Returns
+// [batch, heads, q_len, head_dim] in query's dtype. Registered for
+// TorchScript as qwen::int8_kv_attention.
+at::Tensor int8_kv_attention(const at::Tensor& query,
+                             const at::Tensor& key,
+                             const at::Tensor& value,
+                             const c10::optional<at::Tensor>& attention_mask,
+                             double scaling);
+
+}  // namespace qwen3
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <ATen/ATen.h>
+
+#include <c10/util/Optional.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace qwen3 {
+
+// Plumbing shared by the qwen:: linear kernels (int8/int4, bf16, packed and
+// vector): the input is flattened to fp32 rows, the kernel fills an fp32
+// [rows, out_features] result, and finish_linear gives it back the input's
+// leading dimensions and dtype.
+
+// input as contiguous fp32 [rows, width].
+inline at::Tensor flatten_input(const at::Tensor& input, int64_t width) {
+  return input.reshape({-1, width}).to(at::kFloat).contiguous();
+}
+
+// out [rows, out_features] as input's dtype and shape, last dimension
+// replaced by out_features.
+inline at::Tensor finish_linear(const at::Tensor& out, const at::Tensor& input, int64_t out_features) {
+  std::vector<int64_t> out_shape(input.sizes().begin(), input.sizes().end() - 1);
+  out_shape.push_back(out_features);
+  return out.to(input.scalar_type()).reshape(out_shape);
+}
+
+// fp32 values of bias, kept alive by storage, or nullptr without a bias.
+inline const float* bias_data(const c10::optional<at::Tensor>& bias, at::Tensor& storage) {
+  if (!bias.has_value() || !bias->defined()) {
+    return nullptr;
+  }
+  storage = bias->to(at::kFloat).contiguous();
+  return storage.data_ptr<float>();
+}
+
+}  // namespace qwen3
@@ -0,0 +1,137 @@
+#include "mmap_reader.h"
+
+#include <torch/csrc/jit/api/function_impl.h>
+#include <torch/csrc/jit/ir/ir.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+namespace qwen3 {
+namespace {
+// Records smaller than this stay on the heap: rebinding them saves nothing
+// once page granularity is taken into account.
+constexpr size_t kMinMappedBytes = 4096;
+
+void release_mapping(void* context) {
+  delete static_cast<std::shared_ptr<MappedFile>*>(context);
+}
+
+void collect_graph_constants(torch::jit::Block* block, std::vector<at::Tensor>& tensors) {
+  for (torch::jit::Node* node : block->nodes()) {
+    if (node->kind() == torch::jit::prim::Constant && node->hasAttribute(torch::jit::attr::value) &&
+        node->kindOf(torch::jit::attr::value) == torch::jit::AttributeKind::t) {
+      tensors.push_back(node->t(torch::jit::attr::value));
+    }
+    for (torch::jit::Block* sub_block : node->blocks()) {
+      collect_graph_constants(sub_block, tensors);
+    }
+  }
+}
+
+std::vector<at::Tensor> module_tensors(torch::jit::Module& module) {
+  std::vector<at::Tensor> tensors;
+  for (const auto& attribute : module.named_attributes(/*recurse=*/true)) {
+    if (attribute.value.isTensor()) {
+      tensors.push_back(attribute.value.toTensor());
+    }
+  }
+  // Frozen modules carry their weights as constants inside the graphs.
+  for (torch::jit::Function* function : module._ivalue()->compilation_unit()->get_functions()) {
+    if (function->isGraphFunction()) {
+      collect_graph_constants(torch::jit::toGraphFunction(*function).graph()->block(), tensors);
+    }
+  }
+  return tensors;
+}
+}  // namespace
+
+MappedFile::MappedFile(const std::string& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open " + path + ": " + std::strerror(errno));
+  }
+  struct stat info {};
+  if (::fstat(fd, &info) != 0) {
+    const int err = errno;
+    ::close(fd);
+    throw std::runtime_error("Failed to stat " + path + ": " + std::strerror(err));
+  }
+  size_ = static_cast<size_t>(info.st_size);
+  // Private and writable so a stray in-place write copies one page instead of
+  // faulting; untouched pages stay shared with every other mapping.
+  base_ = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  const int err = errno;
+  ::close(fd);
+  if (base_ == MAP_FAILED) {
+    base_ = nullptr;
+    throw std::runtime_error("Failed to mmap " + path + ": " + std::strerror(err));
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (base_ != nullptr) {
+    ::munmap(base_, size_);
+  }
+}
+
+MappedReadAdapter::MappedReadAdapter(std::shared_ptr<MappedFile> file) : file_(std::move(file)) {}
+
+size_t MappedReadAdapter::read(uint64_t pos, void* buf, size_t n, const char* what) const {
+  TORCH_CHECK(pos <= file_->size(), "MappedReadAdapter: ", what, " read at ", pos,
+              " is past the end of the ", file_->size(), "-byte archive");
+  const size_t count = std::min<size_t>(n, file_->size() - pos);
+  std::memcpy(buf, file_->data() + pos, count);
+  if (count >= kMinMappedBytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    regions_[buf] = Region{pos, count};
+  }
+  return count;
+}
+
+std::unordered_map<const void*, MappedReadAdapter::Region> MappedReadAdapter::regions() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return regions_;
+}
+
+size_t rebind_to_mapping(torch::jit::Module& module, const MappedReadAdapter& adapter) {
+  const std::unordered_map<const void*, MappedReadAdapter::Region> regions = adapter.regions();
+  const MappedFile& file = *adapter.file();
+  std::unordered_set<const void*> done;
+  size_t rebound = 0;
+
+  for (const at::Tensor& tensor : module_tensors(module)) {
+    if (!tensor.defined() || !tensor.has_storage() || !tensor.device().is_cpu()) {
+      continue;
+    }
+    c10::Storage storage = tensor.storage();
+    const void* data = storage.data_ptr().get();
+    if (done.count(data) != 0) {
+      continue;
+    }
+    const auto region = regions.find(data);
+    // A buffer can be freed and its address reused by a tensor that was not
+    // read from the archive, so only rebind when the bytes still match.
+    if (region == regions.end() || region->second.size != storage.nbytes() ||
+        std::memcmp(data, file.data() + region->second.offset, region->second.size) != 0) {
+      continue;
+    }
+    done.insert(data);
+
+    auto* owner = new std::shared_ptr<MappedFile>(adapter.file());
+    void* mapped = const_cast<char*>(file.data() + region->second.offset);
+    storage.set_data_ptr_noswap(at::DataPtr(mapped, owner, &release_mapping, storage.device()));
+    rebound += region->second.size;
+  }
+  return rebound;
+}
+
+}  // namespace qwen3
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <caffe2/serialize/read_adapter_interface.h>
+#include <torch/script.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace qwen3 {
+
+// A read-only view of a whole file, unmapped when the last reference goes.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path);
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  const char* data() const { return static_cast<const char*>(base_); }
+  size_t size() const { return size_; }
+
+ private:
+  void* base_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Feeds torch::jit::load from a memory mapping and remembers where each
+// large record was copied to. TorchScript archives store tensor records
+// uncompressed and 64-byte aligned, so once loading is done the storages that
+// were filled from the file can be pointed back into the mapping and their
+// heap copies released (see rebind_to_mapping).
+class MappedReadAdapter : public caffe2::serialize::ReadAdapterInterface {
+ public:
+  explicit MappedReadAdapter(std::shared_ptr<MappedFile> file);
+
+  size_t size() const override { return file_->size(); }
+  size_t read(uint64_t pos, void* buf, size_t n, const char* what = "") const override;
+
+  const std::shared_ptr<MappedFile>& file() const { return file_; }
+
+  struct Region {
+    uint64_t offset;
+    size_t size;
+  };
+  // Destination buffer -> file region it was last filled from.
+  std::unordered_map<const void*, Region> regions() const;
+
+ private:
+  std::shared_ptr<MappedFile> file_;
+  mutable std::mutex mutex_;
+  mutable std::unordered_map<const void*, Region> regions_;
+};
+
+// Replaces every module tensor storage (attributes and frozen graph
+// constants) whose bytes were read verbatim from the archive with a pointer
+// into the mapping, so the weights are paged in on demand and shared through
+// the page cache. Returns the number of bytes rebound.
+size_t rebind_to_mapping(torch::jit::Module& module, const MappedReadAdapter& adapter);
+
+}  // namespace qwen3
@@ -0,0 +1,278 @@
+#include "model.h"
+
+#include "gzip_reader.h"
+#include "mmap_reader.h"
+#include "packed_linear.h"
+#include "weight_packing.h"
+
+#include <caffe2/serialize/inline_container.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace qwen3 {
+namespace {
+torch::Dtype parse_dtype(const std::string& name) {
+  if (name == "float32") {
+    return torch::kFloat;
+  }
+  if (name == "float16") {
+    return torch::kHalf;
+  }
+  if (name == "bfloat16") {
+    return torch::kBFloat16;
+  }
+  if (name == "float64") {
+    return torch::kDouble;
+  }
+  throw std::runtime_error("Unsupported model dtype in export config: " + name);
+}
+
+StepOutput unpack_step(const c10::IValue& value) {
+  const auto tuple = value.toTuple();
+  return {tuple->elements()[0].toTensor(),
+          tuple->elements()[1].toTensor(),
+          tuple->elements()[2].toTensor()};
+}
+
+torch::jit::Module load_module(const std::string& path,
+                               bool map_weights,
+                               torch::jit::ExtraFilesMap& extra_files) {
+  if (is_gzip_file(path)) {
+    if (map_weights) {
+      throw std::invalid_argument("Cannot memory-map a gzip-compressed model: " + path);
+    }
+    // .ts.gz archives are inflated in-process instead of staged on disk first.
+    return torch::jit::load(std::make_shared<GzipReadAdapter>(path), c10::nullopt, extra_files);
+  }
+  if (map_weights) {
+    auto adapter = std::make_shared<MappedReadAdapter>(std::make_shared<MappedFile>(path));
+    torch::jit::Module module = torch::jit::load(adapter, c10::nullopt, extra_files);
+    const size_t mapped = rebind_to_mapping(module, *adapter);
+    std::cout << "Mapped " << (mapped >> 20) << " MB of weights from " << path << std::endl;
+    return module;
+  }
+  return torch::jit::load(path, c10::nullopt, extra_files);
+}
+
+// Repacked archives are saved next to the model. They carry a stamp naming
+// the source file and the packer's layout, and are reused only while both
+// still match.
+std::string packed_cache_path(const std::string& path) {
+  return path + ".packed";
+}
+
+// Extra file holding the stamp inside a repacked archive.
+constexpr const char* kPackedStampName = "qwen3_packed.cfg";
+// Bump whenever pack_linear_weights changes what it writes.
+constexpr int kPackedCacheFormat = 1;
+
+std::string packed_cache_stamp(const std::string& source) {
+  std::ostringstream stamp;
+  stamp << "format=" << kPackedCacheFormat << "\n"
+        << "pass=pack_linear_weights\n"
+        << "panel_rows=" << kPanelRows << "\n"
+        << "source_size=" << std::filesystem::file_size(source) << "\n"
+        << "source_mtime=" << std::filesystem::last_write_time(source).time_since_epoch().count() << "\n";
+  return stamp.str();
+}
+
+// Reads only the stamp record, so a stale cache is rejected without loading
+// its weights; a missing, torn or foreign file simply does not match.
+bool is_fresh_cache(const std::string& cache, const std::string& stamp) {
+  if (!std::filesystem::exists(cache)) {
+    return false;
+  }
+  try {
+    caffe2::serialize::PyTorchStreamReader reader(cache);
+    const std::string record = std::string("extra/") + kPackedStampName;
+    if (!reader.hasRecord(record)) {
+      return false;
+    }
+    const auto [data, size] = reader.getRecord(record);
+    return std::string(static_cast<const char*>(data.get()), size) == stamp;
+  } catch (const std::exception&) {
+    return false;
+  }
+}
+
+// Writes next to the destination and renames into place, so concurrent
+// loaders and interrupted saves never leave a partial archive under the
+// cache name.
+void save_packed_cache(torch::jit::Module& module,
+                       const std::string& cache,
+                       const torch::jit::ExtraFilesMap& extra_files) {
+  const std::string temp = cache + ".tmp." + std::to_string(::getpid());
+  try {
+    module.save(temp, extra_files);
+    std::filesystem::rename(temp, cache);
+  } catch (...) {
+    std::remove(temp.c_str());
+    throw;
+  }
+}
+}  // namespace
+
+KvCacheDtype parse_kv_cache_dtype(const std::string& name) {
+  if (name == "float") {
+    return KvCacheDtype::kFloat;
+  }
+  if (name == "int8") {
+    return KvCacheDtype::kInt8;
+  }
+  throw std::invalid_argument("Unsupported KV cache dtype: " + name + " (expected float or int8)");
+}
+
+ExportConfig parse_export_config(const std::string& text) {
+  std::unordered_map<std::string, std::string> entries;
+  std::istringstream stream(text);
+  std::string line;
+  while (std::getline(stream, line)) {
+    const auto eq = line.find('=');
+    if (eq == std::string::npos) {
+      continue;
+    }
+    entries[line.substr(0, eq)] = line.substr(eq + 1);
+  }
+
+  ExportConfig config;
+  const auto interface_it = entries.find("interface");
+  if (interface_it == entries.end()) {
+    return config;
+  }
+  if (interface_it->second != "prefill_decode") {
+    throw std::runtime_error("Unsupported model interface: " + interface_it->second);
+  }
+  auto require = [&](const char* key) -> const std::string& {
+    const auto it = entries.find(key);
+    if (it == entries.end()) {
+      throw std::runtime_error(std::string("Export config is missing '") + key + "'");
+    }
+    return it->second;
+  };
+  config.prefill_decode = true;
+  config.num_layers = std::stoll(require("num_layers"));
+  config.num_kv_heads = std::stoll(require("num_kv_heads"));
+  config.head_dim = std::stoll(require("head_dim"));
+  config.dtype = parse_dtype(require("dtype"));
+  const auto head = entries.find("head");
+  config.argmax_head = head != entries.end() && head->second == "argmax";
+  const auto kv_cache = entries.find("kv_cache");
+  if (kv_cache != entries.end()) {
+    std::istringstream dtypes(kv_cache->second);
+    std::string dtype;
+    while (std::getline(dtypes, dtype, ',')) {
+      config.int8_kv_cache = config.int8_kv_cache || dtype == "int8";
+    }
+  }
+  const auto paged = entries.find("paged_kv");
+  config.paged_kv = paged != entries.end() && paged->second == "1";
+  const auto with_past = entries.find("prefill_with_past");
+  config.prefill_with_past = with_past != entries.end() && with_past->second == "1";
+  return config;
+}
+
+void check_kv_cache_supported(const ExportConfig& config, KvCacheDtype dtype) {
+  // Legacy archives re-run forward() and keep no cache at all.
+  if (config.prefill_decode && dtype == KvCacheDtype::kInt8 && !config.int8_kv_cache) {
+    throw std::runtime_error(
+        "Model was exported without an int8 KV cache; re-export it with --int8-kv-cache");
+  }
+}
+
+Qwen3Model::Qwen3Model(torch::jit::Module module, ExportConfig config)
+    : module_(std::move(module)), config_(config) {}
+
+Qwen3Model Qwen3Model::load(const std::string& path, const LoadOptions& options) {
+  if (options.pack_weights + options.bf16_weights + options.xnnpack_linear > 1) {
+    throw std::invalid_argument(
+        "Weight packing, bf16 weight storage and XNNPACK linears are mutually exclusive");
+  }
+  torch::jit::ExtraFilesMap extra_files{{kExportConfigName, ""}};
+  torch::jit::Module module;
+  if (!options.pack_weights) {
+    module = load_module(path, options.map_weights, extra_files);
+  } else if (const std::string cache = packed_cache_path(path), stamp = packed_cache_stamp(path);
+             is_fresh_cache(cache, stamp)) {
+    module = load_module(cache, options.map_weights, extra_files);
+  } else {
+    module = load_module(path, options.map_weights, extra_files);
+    const int64_t packed = pack_linear_weights(module);
+    std::cout << "Packed " << packed << " linear weights" << std::endl;
+    try {
+      torch::jit::ExtraFilesMap cache_files = extra_files;
+      cache_files[kPackedStampName] = stamp;
+      save_packed_cache(module, cache, cache_files);
+      std::cout << "Saved packed model to " << cache << std::endl;
+    } catch (const std::exception& ex) {
+      std::cerr << "[warn] could not save packed model to " << cache << ": " << ex.what() << std::endl;
+    }
+  }
+  if (options.bf16_weights) {
+    const int64_t converted = store_weights_as_bf16(module);
+    std::cout << "Stored " << converted << " weights as bf16" << std::endl;
+  }
+  ExportConfig config = parse_export_config(extra_files[kExportConfigName]);
+  if (options.xnnpack_linear) {
+    if (config.dtype != torch::kFloat) {
+      throw std::invalid_argument("XNNPACK linears need a float32 archive");
+    }
+    const int64_t packed = use_xnnpack_linear(module);
+    std::cout << "Rewrote linears over " << packed << " weights to XNNPACK prepacked linear" << std::endl;
+  }
+  module.eval();
+  return Qwen3Model(std::move(module), config);
+}
+
+StepOutput Qwen3Model::prefill(const torch::Tensor& tokens,
+                               const torch::Tensor& attention_mask,
+                               KvCacheDtype cache_dtype) {
+  check_kv_cache_supported(config_, cache_dtype);
+  const char* method = cache_dtype == KvCacheDtype::kInt8 ? "prefill_int8_kv" : "prefill";
+  return unpack_step(module_.get_method(method)({tokens, attention_mask}));
+}
+
+StepOutput Qwen3Model::decode_step(const torch::Tensor& token,
+                                   const StepOutput& past,
+                                   const torch::Tensor& attention_mask,
+                                   const torch::Tensor& position_ids) {
+  const char* method =
+      past.keys.scalar_type() == torch::kChar ? "decode_step_int8_kv" : "decode_step";
+  return unpack_step(
+      module_.get_method(method)({token, past.keys, past.values, attention_mask, position_ids}));
+}
+
+StepOutput Qwen3Model::prefill_with_past(const torch::Tensor& tokens,
+                                         const StepOutput& past,
+                                         const torch::Tensor& attention_mask,
+                                         const torch::Tensor& position_ids) {
+  TORCH_CHECK(config_.prefill_with_past,
+              "Model was exported without prefill_with_past; re-export it to resume prompts in one pass");
+  const char* method = past.keys.scalar_type() == torch::kChar ? "prefill_with_past_int8_kv"
+                                                                : "prefill_with_past";
+  return unpack_step(
+      module_.get_method(method)({tokens, past.keys, past.values, attention_mask, position_ids}));
+}
+
+StepOutput Qwen3Model::decode_step_paged(const torch::Tensor& token,
+                                         const torch::Tensor& key_pages,
+                                         const torch::Tensor& value_pages,
+                                         const torch::Tensor& block_tables,
+                                         const torch::Tensor& context_lens,
+                                         const torch::Tensor& position_ids) {
+  return unpack_step(module_.get_method("decode_step_paged")(
+      {token, key_pages, value_pages, block_tables, context_lens, position_ids}));
+}
+
+torch::Tensor Qwen3Model::forward(const torch::Tensor& tokens, const torch::Tensor& attention_mask) {
+  return module_.forward({tokens, attention_mask}).toTensor();
+}
+
+}  // namespace qwen3
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <torch/script.h>
+
+#include <string>
+
+namespace qwen3 {
+
+// Name of the extra file export_qwen3_torchscript.py stores next to the code.
+constexpr const char* kExportConfigName = "qwen3_export.cfg";
+
+// Storage of the KV cache passed between prefill and decode_step. kInt8 keeps
+// each key/value vector as int8 plus its fp32 scale (see int8_kv_cache.h).
+enum class KvCacheDtype { kFloat, kInt8 };
+
+KvCacheDtype parse_kv_cache_dtype(const std::string& name);
+
+// Model properties recorded by export_qwen3_torchscript.py. Archives exported
+// before the prefill/decode interface carry no config and only have forward().
+struct ExportConfig {
+  bool prefill_decode = false;
+  int64_t num_layers = 0;
+  int64_t num_kv_heads = 0;
+  int64_t head_dim = 0;
+  torch::Dtype dtype = torch::kFloat;
+  // The graph returns greedy token ids (qwen::lm_head_argmax) instead of logits.
+  bool argmax_head = false;
+  // The archive also has the prefill_int8_kv/decode_step_int8_kv entry points.
+  bool int8_kv_cache = false;
+  // The archive has the decode_step_paged entry point.
+  bool paged_kv = false;
+  // The archive has prefill_with_past (and prefill_with_past_int8_kv with
+  // int8_kv_cache).
+  bool prefill_with_past = false;
+};
+
+ExportConfig parse_export_config(const std::string& text);
+
+// Throws if the archive cannot keep its cache in the requested dtype.
+void check_kv_cache_supported(const ExportConfig& config, KvCacheDtype dtype);
+
+// Outputs of the prefill/decode_step entry points: logits (token ids for an
+// argmax head) plus the grown cache.
+struct StepOutput {
+  torch::Tensor logits;
+  torch::Tensor keys;
+  torch::Tensor values;
+};
+
+struct LoadOptions {
+  // mmap the archive and point weight storages into the mapping instead of
+  // keeping private heap copies.
+  bool map_weights = false;
+  // Repack linear weights into panels for qwen::packed_linear, reusing (or
+  // writing) the repacked archive at <path>.packed.
+  bool pack_weights = false;
+  // Convert fp32 linear/embedding weights to bf16 storage with fp32 compute,
+  // for archives exported without --weight-format bf16.
+  bool bf16_weights = false;
+  // Rewrite fp32 linears into XNNPACK prepacked linear ops; needs a libtorch
+  // built with XNNPACK (build_pytorch_riscv.sh --xnnpack).
+  bool xnnpack_linear = false;
+};
+
+// A loaded TorchScript archive together with its export config.
+class Qwen3Model {
+ public:
+  static Qwen3Model load(const std::string& path, const LoadOptions& options = {});
+
+  const ExportConfig& config() const { return config_; }
+  torch::jit::Module& module() { return module_; }
+
+  // cache_dtype selects the entry points; decode_step follows the dtype of
+  // the cache it is given.
+  StepOutput prefill(const torch::Tensor& tokens,
+                     const torch::Tensor& attention_mask,
+                     KvCacheDtype cache_dtype = KvCacheDtype::kFloat);
+  StepOutput decode_step(const torch::Tensor& token,
+                         const StepOutput& past,
+                         const torch::Tensor& attention_mask,
+                         const torch::Tensor& position_ids);
+  // decode_step for [batch, n] tokens at once, e.g. the rest of a prompt after
+  // a reused prefix; needs config().prefill_with_past. Follows the dtype of
+  // past's cache like decode_step.
+  StepOutput prefill_with_past(const torch::Tensor& tokens,
+                               const StepOutput& past,
+                               const torch::Tensor& attention_mask,
+                               const torch::Tensor& position_ids);
+  // decode_step over a paged cache (see paged_kv_cache.h): key_pages and
+  // value_pages are [layers, pages, kv_heads, page_tokens, head_dim],
+  // block_tables [batch, max_pages] and context_lens [batch] locate each row's
+  // cached tokens. The returned keys/values hold only the new token.
+  StepOutput decode_step_paged(const torch::Tensor& token,
+                               const torch::Tensor& key_pages,
+                               const torch::Tensor& value_pages,
+                               const torch::Tensor& block_tables,
+                               const torch::Tensor& context_lens,
+                               const torch::Tensor& position_ids);
+  // Legacy full-sequence forward() of archives without the prefill/decode interface.
+  torch::Tensor forward(const torch::Tensor& tokens, const torch::Tensor& attention_mask);
+
+ private:
+  Qwen3Model(torch::jit::Module module, ExportConfig config);
+
+  torch::jit::Module module_;
+  ExportConfig config_;
+};
+
+}  // namespace qwen3
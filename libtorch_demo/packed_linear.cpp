@@ -0,0 +1,89 @@
+#include "packed_linear.h"
+
+#include "linear_common.h"
+
+#include <ATen/Dispatch.h>
+#include <ATen/Parallel.h>
+#include <torch/library.h>
+
+#include <algorithm>
+
+namespace qwen3 {
+
+at::Tensor pack_linear_weight(const at::Tensor& weight) {
+  TORCH_CHECK(weight.dim() == 2, "pack_linear_weight: weight must be 2-D, got ", weight.dim(), "-D");
+  const int64_t out_features = weight.size(0);
+  const int64_t in_features = weight.size(1);
+  const int64_t panels = (out_features + kPanelRows - 1) / kPanelRows;
+  const int64_t padded = panels * kPanelRows;
+
+  at::Tensor rows = weight;
+  if (padded != out_features) {
+    rows = at::constant_pad_nd(weight, {0, 0, 0, padded - out_features}, 0);
+  }
+  // [panels * R, K] -> [panels, R, K] -> [panels, K, R]
+  return rows.reshape({panels, kPanelRows, in_features}).transpose(1, 2).contiguous();
+}
+
+at::Tensor packed_linear(const at::Tensor& input,
+                         const at::Tensor& packed,
+                         const c10::optional<at::Tensor>& bias,
+                         int64_t out_features) {
+  TORCH_CHECK(packed.dim() == 3 && packed.size(2) == kPanelRows,
+              "packed_linear: weight is not in the packed [panels, K, ", kPanelRows, "] layout");
+  const int64_t panels = packed.size(0);
+  const int64_t width = packed.size(1);
+  TORCH_CHECK(out_features > (panels - 1) * kPanelRows && out_features <= panels * kPanelRows,
+              "packed_linear: out_features ", out_features, " does not match ", panels, " panels");
+  TORCH_CHECK(input.size(-1) == width, "packed_linear: input size ", input.size(-1),
+              " does not match weight width ", width);
+
+  const at::Tensor rows = flatten_input(input, width);
+  const int64_t m = rows.size(0);
+  at::Tensor out = at::empty({m, out_features}, rows.options());
+  const at::Tensor w = packed.contiguous();
+  at::Tensor bias_storage;
+  const float* bp = bias_data(bias, bias_storage);
+
+  AT_DISPATCH_FLOATING_TYPES_AND2(at::kBFloat16, at::kHalf, w.scalar_type(), "packed_linear", [&] {
+    const float* x = rows.data_ptr<float>();
+    const scalar_t* wp = w.data_ptr<scalar_t>();
+    float* y = out.data_ptr<float>();
+
+    at::parallel_for(0, panels, 1, [&](int64_t begin, int64_t end) {
+      for (int64_t p = begin; p < end; ++p) {
+        const scalar_t* panel = wp + p * width * kPanelRows;
+        const int64_t row0 = p * kPanelRows;
+        const int64_t live = std::min(kPanelRows, out_features - row0);
+        // The panel stays hot in cache while every input row streams past it.
+        for (int64_t i = 0; i < m; ++i) {
+          const float* xi = x + i * width;
+          float acc[kPanelRows] = {};
+          for (int64_t k = 0; k < width; ++k) {
+            const scalar_t* line = panel + k * kPanelRows;
+            const float xk = xi[k];
+            for (int64_t r = 0; r < kPanelRows; ++r) {
+              acc[r] += xk * static_cast<float>(line[r]);
+            }
+          }
+          float* yi = y + i * out_features + row0;
+          for (int64_t r = 0; r < live; ++r) {
+            yi[r] = acc[r] + (bp != nullptr ? bp[row0 + r] : 0.0f);
+          }
+        }
+      }
+    });
+  });
+
+  return finish_linear(out, input, out_features);
+}
+
+}  // namespace qwen3
+
+TORCH_LIBRARY_FRAGMENT(qwen, m) {
+  m.def("packed_linear(Tensor input, Tensor packed, Tensor? bias, int out_features) -> Tensor");
+}
+
+TORCH_LIBRARY_IMPL(qwen, CPU, m) {
+  m.impl("packed_linear", &qwen3::packed_linear);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <ATen/ATen.h>
+
+#include <c10/util/Optional.h>
+
+namespace qwen3 {
+
+// Output rows per panel. One panel column of fp32 weights is exactly one
+// 64-byte cache line, so a GEMV streams whole lines and keeps kPanelRows
+// independent accumulators.
+constexpr int64_t kPanelRows = 16;
+
+// Repacks a row-major [out_features, in_features] linear weight into
+// panel-major [panels, in_features, kPanelRows]: panel p, column k holds
+// W[p * kPanelRows + r][k] for r in [0, kPanelRows). Rows past out_features
+// are zero.
+at::Tensor pack_linear_weight(const at::Tensor& weight);
+
+// input @ W.T + bias with W in pack_linear_weight's layout; out_features
+// removes the zero padding of the last panel. Registered for TorchScript as
+// qwen::packed_linear.
+at::Tensor packed_linear(const at::Tensor& input,
+                         const at::Tensor& packed,
+                         const c10::optional<at::Tensor>& bias,
+                         int64_t out_features);
+
+}  // namespace qwen3
@@ -0,0 +1,299 @@
+#include "paged_kv_cache.h"
+
+#include <ATen/Dispatch.h>
+#include <ATen/Parallel.h>
+#include <torch/library.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace qwen3 {
+namespace {
+int64_t pages_for(int64_t tokens) {
+  return (tokens + kKvPageTokens - 1) / kKvPageTokens;
+}
+}  // namespace
+
+KvPageAllocator::KvPageAllocator(int64_t num_pages) : capacity_(num_pages) {
+  if (num_pages < 1) {
+    throw std::invalid_argument("KV page pool needs at least one page");
+  }
+  // Stored in reverse so pages are first handed out in index order.
+  free_.reserve(static_cast<size_t>(num_pages));
+  for (int64_t page = num_pages - 1; page >= 0; --page) {
+    free_.push_back(page);
+  }
+}
+
+int64_t KvPageAllocator::allocate() {
+  if (free_.empty()) {
+    throw std::runtime_error("KV cache is out of pages (" + std::to_string(capacity_) +
+                             " in the pool)");
+  }
+  const int64_t page = free_.back();
+  free_.pop_back();
+  return page;
+}
+
+void KvPageAllocator::release(const std::vector<int64_t>& pages) {
+  free_.insert(free_.end(), pages.rbegin(), pages.rend());
+}
+
+PagedKvCache::PagedKvCache(int64_t num_pages) : allocator_(num_pages) {}
+
+void PagedKvCache::add(const torch::Tensor& keys,
+                       const torch::Tensor& values,
+                       const torch::Tensor& attention_mask) {
+  TORCH_CHECK(keys.dim() == 5 && keys.sizes() == values.sizes(),
+              "PagedKvCache::add expects matching 5-D key/value caches");
+  TORCH_CHECK(at::isFloatingType(keys.scalar_type()),
+              "PagedKvCache holds float caches; an int8 KV cache cannot be paged");
+  TORCH_CHECK(attention_mask.dim() == 2 && attention_mask.size(0) == keys.size(1) &&
+                  attention_mask.size(1) == keys.size(3),
+              "PagedKvCache::add: attention mask does not match the cache shape");
+  if (!key_pages_.defined()) {
+    key_pages_ = torch::empty(
+        {keys.size(0), allocator_.capacity(), keys.size(2), kKvPageTokens, keys.size(4)},
+        keys.options());
+    value_pages_ = torch::empty_like(key_pages_);
+  }
+  TORCH_CHECK(keys.size(0) == key_pages_.size(0) && keys.size(2) == key_pages_.size(2) &&
+                  keys.size(4) == key_pages_.size(4) &&
+                  keys.scalar_type() == key_pages_.scalar_type(),
+              "PagedKvCache::add: cache shape does not match the page pool");
+
+  // Reserve every new row's pages up front so a full pool rejects the whole
+  // prefill instead of leaving a partial row behind.
+  const torch::Tensor mask = attention_mask.to(torch::kBool);
+  std::vector<torch::Tensor> positions;
+  int64_t needed = 0;
+  for (int64_t r = 0; r < keys.size(1); ++r) {
+    positions.push_back(mask[r].nonzero().squeeze(1));
+    needed += pages_for(positions.back().numel());
+  }
+  if (needed > allocator_.available()) {
+    throw std::runtime_error("KV cache needs " + std::to_string(needed) + " pages for " +
+                             std::to_string(keys.size(1)) + " new rows, " +
+                             std::to_string(allocator_.available()) + " free");
+  }
+
+  for (int64_t r = 0; r < keys.size(1); ++r) {
+    Row row;
+    row.length = positions[r].numel();
+    const torch::Tensor row_keys = keys.select(1, r).index_select(2, positions[r]);
+    const torch::Tensor row_values = values.select(1, r).index_select(2, positions[r]);
+    for (int64_t start = 0; start < row.length; start += kKvPageTokens) {
+      const int64_t page = allocator_.allocate();
+      const int64_t count = std::min(kKvPageTokens, row.length - start);
+      key_pages_.select(1, page).narrow(2, 0, count).copy_(row_keys.narrow(2, start, count));
+      value_pages_.select(1, page).narrow(2, 0, count).copy_(row_values.narrow(2, start, count));
+      row.pages.push_back(page);
+    }
+    rows_.push_back(std::move(row));
+  }
+}
+
+torch::Tensor PagedKvCache::decode(Qwen3Model& model,
+                                   const torch::Tensor& tokens,
+                                   const torch::Tensor& position_ids) {
+  TORCH_CHECK(!rows_.empty(), "PagedKvCache::decode called on an empty batch");
+  TORCH_CHECK(tokens.size(0) == batch_size(), "PagedKvCache::decode: expected ", batch_size(),
+              " rows, got ", tokens.size(0));
+  TORCH_CHECK(tokens.size(1) == 1, "PagedKvCache::decode advances one token per row");
+
+  // Rows whose last page is full need a fresh page for this step's token.
+  auto page_full = [](const Row& row) {
+    return row.length == static_cast<int64_t>(row.pages.size()) * kKvPageTokens;
+  };
+  const int64_t needed = std::count_if(rows_.begin(), rows_.end(), page_full);
+  if (needed > allocator_.available()) {
+    throw std::runtime_error("KV cache is out of pages: " + std::to_string(needed) +
+                             " rows need a new page, " +
+                             std::to_string(allocator_.available()) + " free");
+  }
+  size_t max_pages = 0;
+  for (Row& row : rows_) {
+    if (page_full(row)) {
+      row.pages.push_back(allocator_.allocate());
+    }
+    max_pages = std::max(max_pages, row.pages.size());
+  }
+
+  const int64_t batch = batch_size();
+  torch::Tensor block_tables = torch::zeros({batch, static_cast<int64_t>(max_pages)}, torch::kLong);
+  torch::Tensor context_lens = torch::empty({batch}, torch::kLong);
+  int64_t* table_data = block_tables.data_ptr<int64_t>();
+  int64_t* length_data = context_lens.data_ptr<int64_t>();
+  for (int64_t r = 0; r < batch; ++r) {
+    const Row& row = rows_[r];
+    std::copy(row.pages.begin(), row.pages.end(), table_data + r * static_cast<int64_t>(max_pages));
+    length_data[r] = row.length;
+  }
+
+  const StepOutput out = model.decode_step_paged(
+      tokens, key_pages_, value_pages_, block_tables, context_lens, position_ids);
+  // out.keys/out.values hold only the new token: [layers, batch, kv_heads, 1, head_dim].
+  for (int64_t r = 0; r < batch; ++r) {
+    Row& row = rows_[r];
+    const int64_t page = row.pages[row.length / kKvPageTokens];
+    const int64_t slot = row.length % kKvPageTokens;
+    key_pages_.select(1, page).select(2, slot).copy_(out.keys.select(1, r).select(2, 0));
+    value_pages_.select(1, page).select(2, slot).copy_(out.values.select(1, r).select(2, 0));
+    row.length += 1;
+  }
+  return out.logits;
+}
+
+void PagedKvCache::retain(const std::vector<int64_t>& rows) {
+  if (static_cast<int64_t>(rows.size()) == batch_size()) {
+    return;
+  }
+  std::vector<bool> kept(rows_.size(), false);
+  for (int64_t r : rows) {
+    kept[r] = true;
+  }
+  for (size_t r = 0; r < rows_.size(); ++r) {
+    if (!kept[r]) {
+      allocator_.release(rows_[r].pages);
+    }
+  }
+  std::vector<Row> remaining;
+  remaining.reserve(rows.size());
+  for (int64_t r : rows) {
+    remaining.push_back(std::move(rows_[r]));
+  }
+  rows_ = std::move(remaining);
+}
+
+at::Tensor paged_attention(const at::Tensor& query,
+                           const at::Tensor& key,
+                           const at::Tensor& value,
+                           const at::Tensor& key_pages,
+                           const at::Tensor& value_pages,
+                           const at::Tensor& block_tables,
+                           const at::Tensor& context_lens,
+                           double scaling) {
+  TORCH_CHECK(query.dim() == 4 && query.size(2) == 1,
+              "paged_attention: query must be [batch, heads, 1, head_dim]");
+  TORCH_CHECK(key.dim() == 4 && key.sizes() == value.sizes() && key.size(2) == 1,
+              "paged_attention: key and value must be the new token's [batch, kv_heads, 1, head_dim]");
+  TORCH_CHECK(key_pages.dim() == 4 && key_pages.sizes() == value_pages.sizes() &&
+                  key_pages.scalar_type() == value_pages.scalar_type(),
+              "paged_attention: key and value pages must match");
+  const int64_t batch = query.size(0);
+  const int64_t heads = query.size(1);
+  const int64_t head_dim = query.size(3);
+  const int64_t kv_heads = key.size(1);
+  TORCH_CHECK(key.size(0) == batch && key.size(3) == head_dim,
+              "paged_attention: new keys do not match the query");
+  TORCH_CHECK(key_pages.size(1) == kv_heads && key_pages.size(3) == head_dim,
+              "paged_attention: pages do not match the new keys");
+  TORCH_CHECK(kv_heads > 0 && heads % kv_heads == 0, "paged_attention: ", heads,
+              " query heads cannot share ", kv_heads, " KV heads");
+  TORCH_CHECK(block_tables.dim() == 2 && block_tables.size(0) == batch &&
+                  context_lens.numel() == batch,
+              "paged_attention: expected one block table and context length per row");
+  const int64_t group = heads / kv_heads;
+  const int64_t num_pages = key_pages.size(0);
+  const int64_t page_tokens = key_pages.size(2);
+  const int64_t max_pages = block_tables.size(1);
+
+  const at::Tensor tables = block_tables.to(at::kLong).contiguous();
+  const at::Tensor lens = context_lens.to(at::kLong).contiguous();
+  const int64_t* tp = tables.data_ptr<int64_t>();
+  const int64_t* lp = lens.data_ptr<int64_t>();
+  for (int64_t b = 0; b < batch; ++b) {
+    TORCH_CHECK(lp[b] >= 0 && lp[b] <= max_pages * page_tokens, "paged_attention: row ", b,
+                " has ", lp[b], " cached tokens but only ", max_pages, " pages");
+    for (int64_t p = 0; p * page_tokens < lp[b]; ++p) {
+      const int64_t page = tp[b * max_pages + p];
+      TORCH_CHECK(page >= 0 && page < num_pages, "paged_attention: page ", page,
+                  " out of range for a pool of ", num_pages);
+    }
+  }
+
+  const at::Tensor q = query.to(at::kFloat).contiguous();
+  const at::Tensor new_keys = key.to(at::kFloat).contiguous();
+  const at::Tensor new_values = value.to(at::kFloat).contiguous();
+  const at::Tensor kp = key_pages.contiguous();
+  const at::Tensor vp = value_pages.contiguous();
+  at::Tensor out = at::empty({batch, heads, 1, head_dim}, q.options());
+
+  const float* qp = q.data_ptr<float>();
+  const float* nkp = new_keys.data_ptr<float>();
+  const float* nvp = new_values.data_ptr<float>();
+  float* op = out.data_ptr<float>();
+  const float scale = static_cast<float>(scaling);
+  AT_DISPATCH_FLOATING_TYPES_AND2(at::kBFloat16, at::kHalf, kp.scalar_type(), "paged_attention", [&] {
+    const scalar_t* key_data = kp.data_ptr<scalar_t>();
+    const scalar_t* value_data = vp.data_ptr<scalar_t>();
+    at::parallel_for(0, batch * heads, 1, [&](int64_t begin, int64_t end) {
+      std::vector<float> scores;
+      std::vector<float> acc(static_cast<size_t>(head_dim));
+      for (int64_t task = begin; task < end; ++task) {
+        const int64_t b = task / heads;
+        const int64_t g = (task % heads) / group;
+        const int64_t length = lp[b];
+        const int64_t* table = tp + b * max_pages;
+        // Row j of the sequence lives at slot j % page_tokens of its page.
+        auto cached_row = [&](const scalar_t* pages, int64_t j) {
+          return pages + ((table[j / page_tokens] * kv_heads + g) * page_tokens + j % page_tokens) * head_dim;
+        };
+        const float* qrow = qp + task * head_dim;
+        const float* new_key = nkp + (b * kv_heads + g) * head_dim;
+        const float* new_value = nvp + (b * kv_heads + g) * head_dim;
+        scores.resize(static_cast<size_t>(length + 1));
+
+        for (int64_t j = 0; j < length; ++j) {
+          const scalar_t* kr = cached_row(key_data, j);
+          float dot = 0.0f;
+          for (int64_t d = 0; d < head_dim; ++d) {
+            dot += qrow[d] * static_cast<float>(kr[d]);
+          }
+          scores[j] = dot * scale;
+        }
+        float dot = 0.0f;
+        for (int64_t d = 0; d < head_dim; ++d) {
+          dot += qrow[d] * new_key[d];
+        }
+        scores[length] = dot * scale;
+
+        const float max_score = *std::max_element(scores.begin(), scores.end());
+        float sum = 0.0f;
+        for (float& score : scores) {
+          score = std::exp(score - max_score);
+          sum += score;
+        }
+        std::fill(acc.begin(), acc.end(), 0.0f);
+        for (int64_t j = 0; j < length; ++j) {
+          const scalar_t* vr = cached_row(value_data, j);
+          const float weight = scores[j];
+          for (int64_t d = 0; d < head_dim; ++d) {
+            acc[d] += weight * static_cast<float>(vr[d]);
+          }
+        }
+        float* dst = op + task * head_dim;
+        const float inverse_sum = 1.0f / sum;
+        for (int64_t d = 0; d < head_dim; ++d) {
+          dst[d] = (acc[d] + scores[length] * new_value[d]) * inverse_sum;
+        }
+      }
+    });
+  });
+  return out.to(query.scalar_type());
+}
+
+}  // namespace qwen3
+
+TORCH_LIBRARY_FRAGMENT(qwen, m) {
+  m.def(
+      "paged_attention(Tensor query, Tensor key, Tensor value, Tensor key_pages, "
+      "Tensor value_pages, Tensor block_tables, Tensor context_lens, float scaling) -> Tensor");
+}
+
+TORCH_LIBRARY_IMPL(qwen, CPU, m) {
+  m.impl("paged_attention", &qwen3::paged_attention);
+}
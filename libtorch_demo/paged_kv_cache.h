@@ -0,0 +1,84 @@
+#pragma once
+
+#include <ATen/ATen.h>
+
+#include "batching.h"
+#include "model.h"
+
+#include <vector>
+
+namespace qwen3 {
+
+// Tokens per KV page. A page holds every layer's keys (or values) for this
+// many consecutive positions of one sequence.
+constexpr int64_t kKvPageTokens = 16;
+
+// Free list over a fixed pool of page indices. Released pages are handed out
+// again first, so the pool's memory is only touched as far as the peak number
+// of pages in use.
+class KvPageAllocator {
+ public:
+  explicit KvPageAllocator(int64_t num_pages);
+
+  int64_t capacity() const { return capacity_; }
+  int64_t available() const { return static_cast<int64_t>(free_.size()); }
+
+  // Throws when the pool is exhausted.
+  int64_t allocate();
+  void release(const std::vector<int64_t>& pages);
+
+ private:
+  int64_t capacity_;
+  std::vector<int64_t> free_;
+};
+
+// Batch KV cache backed by fixed-size pages instead of padded tensors. Each
+// sequence owns a block table of page indices and grows one page at a time,
+// so nothing is preallocated for prompt_len + max_new_tokens and rows of
+// different lengths never pad each other. Decoding goes through the model's
+// decode_step_paged entry point, whose attention (qwen::paged_attention)
+// gathers keys and values through the block tables. Holds float caches only.
+class PagedKvCache : public DecodeCache {
+ public:
+  explicit PagedKvCache(int64_t num_pages);
+
+  int64_t batch_size() const override { return static_cast<int64_t>(rows_.size()); }
+  int64_t pages_in_use() const { return allocator_.capacity() - allocator_.available(); }
+
+  // Copies each row's unmasked prefill positions into freshly allocated pages.
+  void add(const torch::Tensor& keys, const torch::Tensor& values, const torch::Tensor& attention_mask) override;
+  torch::Tensor decode(Qwen3Model& model, const torch::Tensor& tokens, const torch::Tensor& position_ids) override;
+  // Returns the pages of every dropped row to the free list.
+  void retain(const std::vector<int64_t>& rows) override;
+
+ private:
+  struct Row {
+    std::vector<int64_t> pages;
+    int64_t length = 0;
+  };
+
+  KvPageAllocator allocator_;
+  // [layers, num_pages, kv_heads, kKvPageTokens, head_dim], allocated on the
+  // first add() and committed by the OS page by page as it is written.
+  torch::Tensor key_pages_;
+  torch::Tensor value_pages_;
+  std::vector<Row> rows_;
+};
+
+// Attention for one new token per row over a paged cache plus the token's own
+// key/value. query is [batch, heads, 1, head_dim]; key and value are the new
+// token's [batch, kv_heads, 1, head_dim]; key_pages and value_pages are one
+// layer's [num_pages, kv_heads, page_tokens, head_dim]; block_tables [batch,
+// max_pages] lists each row's pages in order and context_lens [batch] how many
+// cached positions they hold. Returns [batch, heads, 1, head_dim]. Registered
+// for TorchScript as qwen::paged_attention.
+at::Tensor paged_attention(const at::Tensor& query,
+                           const at::Tensor& key,
+                           const at::Tensor& value,
+                           const at::Tensor& key_pages,
+                           const at::Tensor& value_pages,
+                           const at::Tensor& block_tables,
+                           const at::Tensor& context_lens,
+                           double scaling);
+
+}  // namespace qwen3
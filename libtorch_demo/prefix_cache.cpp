@@ -0,0 +1,470 @@
+#include "prefix_cache.h"
+
+#include "int8_kv_cache.h"
+#include "mmap_reader.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace qwen3 {
+namespace {
+constexpr char kEntryMagic[8] = {'Q', 'W', 'P', 'R', 'E', 'F', 'X', '2'};
+// Keys and values start on a cache-line boundary of the mapping.
+constexpr uint64_t kDataAlignment = 64;
+// Copies of blocks waiting for the writer thread; blocks queued beyond this
+// are dropped and written by a later request with the same prefix.
+constexpr uint64_t kMaxPendingBytes = uint64_t{64} << 20;
+constexpr uint64_t kFnvOffset = 1469598103934665603ull;
+constexpr uint64_t kFnvPrime = 1099511628211ull;
+constexpr int64_t kBlockTokens = PrefixCache::kPrefixBlockTokens;
+// Longest prompt tail decoded one token at a time on archives without
+// prefill_with_past; longer tails are cheaper to prefill with the prefix.
+constexpr int64_t kMaxDecodedSuffix = kBlockTokens;
+
+struct EntryHeader {
+  char magic[8];
+  uint64_t model_id;
+  // Chained hash of every token before this block; with the block's own
+  // tokens it tells a hash collision from a real match.
+  uint64_t parent_hash;
+  int64_t start;
+  int64_t length;
+  int64_t num_layers;
+  int64_t num_kv_heads;
+  int64_t row_width;
+  int32_t dtype;
+  int32_t reserved;
+  uint64_t data_offset;
+};
+
+// One block copied out of a prefill's cache, waiting to be written.
+struct BlockJob {
+  std::string path;
+  EntryHeader header;
+  std::vector<int64_t> tokens;
+  torch::Tensor keys;
+  torch::Tensor values;
+
+  uint64_t bytes() const { return keys.nbytes() + values.nbytes(); }
+};
+
+uint64_t fnv1a(uint64_t hash, const void* data, size_t size) {
+  const auto* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * kFnvPrime;
+  }
+  return hash;
+}
+
+// Hash state before the first token: entries of other models, transforms or
+// cache layouts never share a name.
+uint64_t entry_seed(uint64_t model_id, int32_t dtype_code, int64_t row_width) {
+  uint64_t hash = fnv1a(kFnvOffset, &model_id, sizeof(model_id));
+  hash = fnv1a(hash, &dtype_code, sizeof(dtype_code));
+  return fnv1a(hash, &row_width, sizeof(row_width));
+}
+
+uint64_t block_hash(uint64_t parent, const std::vector<int64_t>& prompt, int64_t block) {
+  return fnv1a(parent, prompt.data() + block * kBlockTokens, kBlockTokens * sizeof(int64_t));
+}
+
+uint64_t model_identity(const std::string& path, const ExportConfig& config, const LoadOptions& load) {
+  std::error_code error;
+  const std::string canonical = std::filesystem::weakly_canonical(path, error).string();
+  const uintmax_t size = std::filesystem::file_size(path, error);
+  if (error) {
+    throw std::runtime_error("Cannot stat model " + path + ": " + error.message());
+  }
+  const int64_t mtime = std::filesystem::last_write_time(path).time_since_epoch().count();
+  uint64_t hash = fnv1a(kFnvOffset, canonical.data(), canonical.size());
+  hash = fnv1a(hash, &size, sizeof(size));
+  hash = fnv1a(hash, &mtime, sizeof(mtime));
+  // Load-time weight transforms change the numerics of every cached key and
+  // value; --mmap does not.
+  const uint8_t transforms[3] = {load.pack_weights, load.bf16_weights, load.xnnpack_linear};
+  hash = fnv1a(hash, transforms, sizeof(transforms));
+  const int32_t dtype = static_cast<int32_t>(config.dtype);
+  return fnv1a(hash, &dtype, sizeof(dtype));
+}
+
+torch::ScalarType cache_scalar_type(const ExportConfig& config, KvCacheDtype dtype) {
+  return dtype == KvCacheDtype::kInt8 ? torch::kChar : config.dtype;
+}
+
+int64_t cache_row_width(const ExportConfig& config, KvCacheDtype dtype) {
+  return dtype == KvCacheDtype::kInt8 ? config.head_dim + kKvScaleBytes : config.head_dim;
+}
+
+uint64_t align_up(uint64_t value) {
+  return (value + kDataAlignment - 1) / kDataAlignment * kDataAlignment;
+}
+
+void write_block(const BlockJob& job) {
+  const std::string temp = job.path + ".tmp." + std::to_string(::getpid());
+  {
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      throw std::runtime_error("Cannot create " + temp);
+    }
+    const uint64_t token_bytes = job.tokens.size() * sizeof(int64_t);
+    const std::vector<char> padding(job.header.data_offset - sizeof(job.header) - token_bytes, 0);
+    out.write(reinterpret_cast<const char*>(&job.header), sizeof(job.header));
+    out.write(reinterpret_cast<const char*>(job.tokens.data()), static_cast<std::streamsize>(token_bytes));
+    out.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+    out.write(static_cast<const char*>(job.keys.data_ptr()), static_cast<std::streamsize>(job.keys.nbytes()));
+    out.write(static_cast<const char*>(job.values.data_ptr()), static_cast<std::streamsize>(job.values.nbytes()));
+    if (!out.flush()) {
+      std::remove(temp.c_str());
+      throw std::runtime_error("Failed to write " + temp);
+    }
+  }
+  std::filesystem::rename(temp, job.path);
+}
+}  // namespace
+
+// Writes queued blocks on its own thread and keeps the directory under its
+// size cap. Destruction finishes the queue first.
+class PrefixCache::Writer {
+ public:
+  Writer(std::string directory, uint64_t max_bytes)
+      : directory_(std::move(directory)), max_bytes_(max_bytes), owner_(::getpid()),
+        thread_([this] { run(); }) {}
+
+  ~Writer() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    ready_.notify_one();
+    thread_.join();
+  }
+
+  pid_t owner() const { return owner_; }
+
+  void enqueue(std::vector<BlockJob> jobs) {
+    size_t dropped = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (BlockJob& job : jobs) {
+        if (pending_bytes_ + job.bytes() > kMaxPendingBytes) {
+          ++dropped;
+          continue;
+        }
+        pending_bytes_ += job.bytes();
+        queue_.push_back(std::move(job));
+      }
+    }
+    ready_.notify_one();
+    if (dropped != 0) {
+      std::cerr << "[prefix-cache] writer busy; skipped " << dropped << " blocks" << std::endl;
+    }
+  }
+
+ private:
+  void run() {
+    while (true) {
+      BlockJob job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+          return;
+        }
+        job = std::move(queue_.front());
+        queue_.pop_front();
+      }
+      try {
+        write_block(job);
+      } catch (const std::exception& ex) {
+        std::cerr << "[warn] could not store prefix cache block: " << ex.what() << std::endl;
+      }
+      bool idle = false;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_bytes_ -= job.bytes();
+        idle = queue_.empty();
+      }
+      if (idle && max_bytes_ > 0) {
+        evict();
+      }
+    }
+  }
+
+  // Deletes the least recently used blocks (lookup refreshes their mtime)
+  // until the directory fits max_bytes_. A block evicted from the middle of a
+  // chain makes later ones unreachable; they are never refreshed again and go
+  // next.
+  void evict() {
+    struct Stored {
+      std::filesystem::file_time_type used;
+      uintmax_t size;
+      std::filesystem::path path;
+    };
+    std::vector<Stored> stored;
+    uintmax_t total = 0;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory_, error)) {
+      if (entry.path().extension() != ".kv" || !entry.is_regular_file(error)) {
+        continue;
+      }
+      const uintmax_t size = entry.file_size(error);
+      const auto used = entry.last_write_time(error);
+      if (error) {
+        continue;
+      }
+      stored.push_back({used, size, entry.path()});
+      total += size;
+    }
+    if (total <= max_bytes_) {
+      return;
+    }
+    std::sort(stored.begin(), stored.end(),
+              [](const Stored& lhs, const Stored& rhs) { return lhs.used < rhs.used; });
+    for (const Stored& entry : stored) {
+      if (total <= max_bytes_) {
+        break;
+      }
+      // Another process may have evicted it already.
+      std::filesystem::remove(entry.path, error);
+      total -= entry.size;
+    }
+  }
+
+  const std::string directory_;
+  const uint64_t max_bytes_;
+  const pid_t owner_;
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<BlockJob> queue_;
+  uint64_t pending_bytes_ = 0;
+  bool stopping_ = false;
+  std::thread thread_;
+};
+
+PrefixCache::PrefixCache(std::string directory,
+                         const std::string& model_path,
+                         const ExportConfig& config,
+                         const LoadOptions& load,
+                         uint64_t max_bytes)
+    : directory_(std::move(directory)),
+      model_id_(model_identity(model_path, config, load)),
+      config_(config),
+      max_bytes_(max_bytes) {
+  if (!config_.prefill_decode) {
+    throw std::runtime_error("The prefix cache needs a model exported with prefill/decode_step");
+  }
+  std::filesystem::create_directories(directory_);
+}
+
+PrefixCache::~PrefixCache() {
+  if (writer_ && writer_->owner() != ::getpid()) {
+    // Inherited across fork(): the thread only exists in the parent.
+    (void)writer_.release();
+  }
+}
+
+PrefixCache::Writer& PrefixCache::writer() const {
+  std::lock_guard<std::mutex> lock(writer_mutex_);
+  if (writer_ && writer_->owner() != ::getpid()) {
+    (void)writer_.release();
+  }
+  if (!writer_) {
+    writer_ = std::make_unique<Writer>(directory_, max_bytes_);
+  }
+  return *writer_;
+}
+
+std::string PrefixCache::entry_path(uint64_t hash) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.kv", static_cast<unsigned long long>(hash));
+  return directory_ + "/" + name;
+}
+
+c10::optional<PrefixCache::Entry> PrefixCache::lookup(const std::vector<int64_t>& prompt,
+                                                       KvCacheDtype dtype) const {
+  // At least the last prompt token is left to the forward that yields its
+  // logits.
+  const int64_t blocks = (static_cast<int64_t>(prompt.size()) - 1) / kBlockTokens;
+  if (blocks <= 0) {
+    return c10::nullopt;
+  }
+  const torch::ScalarType scalar_type = cache_scalar_type(config_, dtype);
+  const int64_t row_width = cache_row_width(config_, dtype);
+  const int32_t dtype_code = static_cast<int32_t>(scalar_type);
+  const uint64_t token_bytes = kBlockTokens * sizeof(int64_t);
+  const uint64_t kv_bytes =
+      static_cast<uint64_t>(config_.num_layers * config_.num_kv_heads * kBlockTokens * row_width) *
+      c10::elementSize(scalar_type);
+  const std::vector<int64_t> shape{config_.num_layers, 1, config_.num_kv_heads, kBlockTokens, row_width};
+  const auto options = torch::TensorOptions().dtype(scalar_type);
+
+  // Walk the chain from the first block and stop at the first one missing.
+  std::vector<torch::Tensor> keys;
+  std::vector<torch::Tensor> values;
+  std::vector<std::string> used;
+  uint64_t hash = entry_seed(model_id_, dtype_code, row_width);
+  for (int64_t block = 0; block < blocks; ++block) {
+    const uint64_t parent = hash;
+    hash = block_hash(parent, prompt, block);
+    const std::string path = entry_path(hash);
+    if (::access(path.c_str(), R_OK) != 0) {
+      break;
+    }
+    std::shared_ptr<MappedFile> file;
+    try {
+      file = std::make_shared<MappedFile>(path);
+    } catch (const std::exception&) {
+      break;
+    }
+    EntryHeader header{};
+    if (file->size() < sizeof(header)) {
+      break;
+    }
+    std::memcpy(&header, file->data(), sizeof(header));
+    const int64_t start = block * kBlockTokens;
+    // A hash collision or an entry from an older layout is skipped, not trusted.
+    if (std::memcmp(header.magic, kEntryMagic, sizeof(kEntryMagic)) != 0 ||
+        header.model_id != model_id_ || header.parent_hash != parent || header.start != start ||
+        header.length != kBlockTokens || header.num_layers != config_.num_layers ||
+        header.num_kv_heads != config_.num_kv_heads || header.row_width != row_width ||
+        header.dtype != dtype_code || header.data_offset < sizeof(header) + token_bytes ||
+        header.data_offset + 2 * kv_bytes != file->size() ||
+        std::memcmp(file->data() + sizeof(header), prompt.data() + start, token_bytes) != 0) {
+      break;
+    }
+
+    auto keep_mapped = [file](void*) {};
+    char* data = const_cast<char*>(file->data()) + header.data_offset;
+    keys.push_back(torch::from_blob(data, shape, keep_mapped, options));
+    values.push_back(torch::from_blob(data + kv_bytes, shape, keep_mapped, options));
+    used.push_back(path);
+  }
+  if (keys.empty()) {
+    return c10::nullopt;
+  }
+
+  // The mtime doubles as the last-use time for eviction.
+  const auto now = std::filesystem::file_time_type::clock::now();
+  for (const std::string& path : used) {
+    std::error_code error;
+    std::filesystem::last_write_time(path, now, error);
+  }
+  Entry entry;
+  entry.length = static_cast<int64_t>(keys.size()) * kBlockTokens;
+  // A single block is used in place; longer prefixes are joined once.
+  entry.keys = keys.size() == 1 ? keys.front() : torch::cat(keys, 3);
+  entry.values = values.size() == 1 ? values.front() : torch::cat(values, 3);
+  return entry;
+}
+
+void PrefixCache::store(const std::vector<int64_t>& prompt,
+                        int64_t cached_length,
+                        const torch::Tensor& keys,
+                        const torch::Tensor& values) const {
+  const int64_t blocks = (static_cast<int64_t>(prompt.size()) - 1) / kBlockTokens;
+  const int64_t first = std::max<int64_t>(cached_length, 0) / kBlockTokens;
+  if (first >= blocks) {
+    return;
+  }
+  TORCH_CHECK(keys.dim() == 5 && keys.sizes() == values.sizes() && keys.size(1) == 1 &&
+                  keys.size(3) >= blocks * kBlockTokens,
+              "PrefixCache::store expects [layers, 1, kv_heads, seq, row_width] caches");
+  const int32_t dtype_code = static_cast<int32_t>(keys.scalar_type());
+  const int64_t row_width = keys.size(4);
+
+  std::vector<BlockJob> jobs;
+  uint64_t hash = entry_seed(model_id_, dtype_code, row_width);
+  for (int64_t block = 0; block < blocks; ++block) {
+    const uint64_t parent = hash;
+    hash = block_hash(parent, prompt, block);
+    if (block < first) {
+      continue;
+    }
+    const int64_t start = block * kBlockTokens;
+    BlockJob job;
+    job.path = entry_path(hash);
+    std::memset(&job.header, 0, sizeof(job.header));
+    std::memcpy(job.header.magic, kEntryMagic, sizeof(kEntryMagic));
+    job.header.model_id = model_id_;
+    job.header.parent_hash = parent;
+    job.header.start = start;
+    job.header.length = kBlockTokens;
+    job.header.num_layers = keys.size(0);
+    job.header.num_kv_heads = keys.size(2);
+    job.header.row_width = row_width;
+    job.header.dtype = dtype_code;
+    job.header.data_offset = align_up(sizeof(EntryHeader) + kBlockTokens * sizeof(int64_t));
+    job.tokens.assign(prompt.begin() + start, prompt.begin() + start + kBlockTokens);
+    // Copies, so the caller may keep growing or freeing its cache.
+    job.keys = keys.narrow(3, start, kBlockTokens).clone(at::MemoryFormat::Contiguous);
+    job.values = values.narrow(3, start, kBlockTokens).clone(at::MemoryFormat::Contiguous);
+    jobs.push_back(std::move(job));
+  }
+  writer().enqueue(std::move(jobs));
+}
+
+StepOutput prefill_with_prefix_cache(Qwen3Model& model,
+                                     const std::vector<int64_t>& prompt,
+                                     KvCacheDtype dtype,
+                                     const PrefixCache& cache) {
+  const int64_t length = static_cast<int64_t>(prompt.size());
+  c10::optional<PrefixCache::Entry> hit = cache.lookup(prompt, dtype);
+  // Blocks already stored, whether or not they are used below.
+  const int64_t stored = hit ? hit->length : 0;
+  // Without prefill_with_past the uncached tail is decoded token by token,
+  // which only beats a full prefill when the tail is short.
+  if (hit && !model.config().prefill_with_past && length - hit->length > kMaxDecodedSuffix) {
+    std::cerr << "[prefix-cache] " << length - hit->length << " uncached tokens; prefilling "
+              << "instead (re-export for prefill_with_past)" << std::endl;
+    hit.reset();
+  }
+  StepOutput state;
+  if (hit) {
+    std::cerr << "[prefix-cache] reusing " << hit->length << " of " << length << " prompt tokens"
+              << std::endl;
+    state.keys = hit->keys;
+    state.values = hit->values;
+    if (model.config().prefill_with_past) {
+      // The rest of the prompt in one forward over the reused cache.
+      const std::vector<int64_t> suffix(prompt.begin() + hit->length, prompt.end());
+      state = model.prefill_with_past(torch::tensor(suffix, torch::kLong).unsqueeze(0),
+                                      state,
+                                      torch::ones({1, length}, torch::kLong),
+                                      torch::arange(hit->length, length, torch::kLong).unsqueeze(0));
+    } else {
+      for (int64_t position = hit->length; position < length; ++position) {
+        state = model.decode_step(torch::full({1, 1}, prompt[position], torch::kLong),
+                                  state,
+                                  torch::ones({1, position + 1}, torch::kLong),
+                                  torch::full({1, 1}, position, torch::kLong));
+      }
+    }
+  } else {
+    const torch::Tensor tokens = torch::tensor(prompt, torch::kLong).unsqueeze(0);
+    state = model.prefill(tokens, torch::ones_like(tokens), dtype);
+  }
+
+  // Whole blocks of everything but the last token are stored, so an
+  // identical prompt later still runs a forward that yields its logits, and a
+  // prompt sharing only the first blocks reuses those.
+  try {
+    cache.store(prompt, stored, state.keys, state.values);
+  } catch (const std::exception& ex) {
+    std::cerr << "[warn] could not store prefix cache entry: " << ex.what() << std::endl;
+  }
+  return state;
+}
+
+}  // namespace qwen3
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <torch/script.h>
+
+#include "model.h"
+
+#include <c10/util/Optional.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace qwen3 {
+
+// Directory of prompt KV caches that survives across runs. Prompts are cut
+// into blocks of kPrefixBlockTokens tokens, and each block's keys and values
+// live in a flat binary file named after a hash chained over the model, the
+// cache layout and every token up to the end of that block:
+//
+//   header | int64 tokens[block] | pad to 64 | keys | values
+//
+// keys and values are [layers, 1, kv_heads, block, row_width] in the cache
+// dtype. Because names depend only on the tokens before them, prompts that
+// share a system prompt share its blocks whatever follows, and a lookup
+// probes one file per block boundary. Blocks are written by a background
+// thread to a temporary file and renamed, so neither the caller's decode loop
+// nor concurrent runs and server workers ever wait on or see a partial file.
+class PrefixCache {
+ public:
+  // Prompt tokens per stored block.
+  static constexpr int64_t kPrefixBlockTokens = 32;
+
+  // model_path identifies the archive (by path, size and mtime) and load the
+  // weight transforms applied to it; entries written for any other model or
+  // transform are never matched. Once the directory holds more than max_bytes
+  // of blocks, the least recently used ones are deleted (0 = no limit).
+  PrefixCache(std::string directory,
+              const std::string& model_path,
+              const ExportConfig& config,
+              const LoadOptions& load,
+              uint64_t max_bytes);
+  ~PrefixCache();
+
+  struct Entry {
+    int64_t length = 0;
+    torch::Tensor keys;
+    torch::Tensor values;
+  };
+
+  // Longest run of stored blocks that is a proper prefix of prompt, for a
+  // cache of the given dtype. Marks the blocks used for eviction.
+  c10::optional<Entry> lookup(const std::vector<int64_t>& prompt, KvCacheDtype dtype) const;
+
+  // Queues every whole block of prompt's proper prefix from token
+  // cached_length on (a block boundary, usually lookup's result) for writing.
+  // keys/values are [layers, 1, kv_heads, >= prompt.size() - 1, row_width].
+  // Returns once the blocks are copied; the files are written in the
+  // background.
+  void store(const std::vector<int64_t>& prompt,
+             int64_t cached_length,
+             const torch::Tensor& keys,
+             const torch::Tensor& values) const;
+
+ private:
+  class Writer;
+
+  std::string entry_path(uint64_t hash) const;
+  Writer& writer() const;
+
+  std::string directory_;
+  uint64_t model_id_;
+  ExportConfig config_;
+  uint64_t max_bytes_;
+  // Started on the first store in each process: a server's workers fork
+  // after the cache is created and do not inherit the parent's thread.
+  mutable std::mutex writer_mutex_;
+  mutable std::unique_ptr<Writer> writer_;
+};
+
+// Prefill for a single [1, len] prompt that resumes from the longest cached
+// prefix, running the remaining prompt tokens in one prefill_with_past call,
+// and then queues the prompt's new blocks for later runs. Archives exported
+// without prefill_with_past decode a short remainder token by token and
+// prefill a long one from scratch. The result matches
+// Qwen3Model::prefill: last-position logits plus the whole prompt's cache.
+StepOutput prefill_with_prefix_cache(Qwen3Model& model,
+                                     const std::vector<int64_t>& prompt,
+                                     KvCacheDtype dtype,
+                                     const PrefixCache& cache);
+
+}  // namespace qwen3
@@ -0,0 +1,144 @@
+#include "quantized_linear.h"
+
+#include "linear_common.h"
+
+#include <ATen/Parallel.h>
+#include <torch/library.h>
+
+#include <algorithm>
+
+namespace qwen3 {
+namespace {
+// Output channels per task. 64 int8 rows of a 3072-wide matrix are 192 KB,
+// small enough to stay in L2 while every input row is scored against them.
+constexpr int64_t kRowTile = 64;
+}  // namespace
+
+at::Tensor int8_linear(const at::Tensor& input,
+                       const at::Tensor& qweight,
+                       const at::Tensor& scale,
+                       const c10::optional<at::Tensor>& bias) {
+  TORCH_CHECK(qweight.dim() == 2 && qweight.scalar_type() == at::kChar,
+              "int8_linear: qweight must be a 2-D int8 tensor");
+  const int64_t out_features = qweight.size(0);
+  const int64_t width = qweight.size(1);
+  TORCH_CHECK(scale.numel() == out_features, "int8_linear: expected ", out_features,
+              " scales, got ", scale.numel());
+  TORCH_CHECK(input.size(-1) == width, "int8_linear: input size ", input.size(-1),
+              " does not match weight width ", width);
+
+  const at::Tensor rows = flatten_input(input, width);
+  const int64_t m = rows.size(0);
+  const at::Tensor w = qweight.contiguous();
+  const at::Tensor s = scale.to(at::kFloat).contiguous();
+  at::Tensor bias_storage;
+  const float* bp = bias_data(bias, bias_storage);
+  at::Tensor out = at::empty({m, out_features}, rows.options());
+
+  const float* x = rows.data_ptr<float>();
+  const int8_t* wp = w.data_ptr<int8_t>();
+  const float* sp = s.data_ptr<float>();
+  float* y = out.data_ptr<float>();
+  const int64_t tiles = (out_features + kRowTile - 1) / kRowTile;
+  at::parallel_for(0, tiles, 1, [&](int64_t begin, int64_t end) {
+    for (int64_t tile = begin; tile < end; ++tile) {
+      const int64_t row_end = std::min(out_features, (tile + 1) * kRowTile);
+      for (int64_t i = 0; i < m; ++i) {
+        const float* xi = x + i * width;
+        for (int64_t n = tile * kRowTile; n < row_end; ++n) {
+          const int8_t* wn = wp + n * width;
+          float acc = 0.0f;
+          for (int64_t k = 0; k < width; ++k) {
+            acc += xi[k] * static_cast<float>(wn[k]);
+          }
+          // The per-channel scale is common to the whole row, so it is
+          // applied once to the accumulated sum.
+          y[i * out_features + n] = acc * sp[n] + (bp != nullptr ? bp[n] : 0.0f);
+        }
+      }
+    }
+  });
+  return finish_linear(out, input, out_features);
+}
+
+at::Tensor int4_linear(const at::Tensor& input,
+                       const at::Tensor& qweight,
+                       const at::Tensor& scales,
+                       const at::Tensor& zeros,
+                       int64_t group_size,
+                       const c10::optional<at::Tensor>& bias) {
+  TORCH_CHECK(qweight.dim() == 2 && qweight.scalar_type() == at::kByte,
+              "int4_linear: qweight must be a 2-D uint8 tensor");
+  const int64_t out_features = qweight.size(0);
+  const int64_t width = qweight.size(1) * 2;
+  TORCH_CHECK(group_size > 0 && group_size % 2 == 0 && width % group_size == 0,
+              "int4_linear: group size ", group_size, " must be even and divide ", width);
+  const int64_t groups = width / group_size;
+  TORCH_CHECK(scales.numel() == out_features * groups && zeros.numel() == out_features * groups,
+              "int4_linear: expected ", out_features, "x", groups, " scales and zero-points");
+  TORCH_CHECK(input.size(-1) == width, "int4_linear: input size ", input.size(-1),
+              " does not match weight width ", width);
+
+  const at::Tensor rows = flatten_input(input, width);
+  const int64_t m = rows.size(0);
+  const at::Tensor w = qweight.contiguous();
+  const at::Tensor s = scales.to(at::kFloat).contiguous();
+  const at::Tensor z = zeros.to(at::kFloat).contiguous();
+  at::Tensor bias_storage;
+  const float* bp = bias_data(bias, bias_storage);
+  at::Tensor out = at::empty({m, out_features}, rows.options());
+
+  // sum_k x_k * (q_k - zero) * scale = scale * (sum_k x_k * q_k - zero * sum_k x_k),
+  // so the per-group input sums are computed once and shared by every row.
+  const at::Tensor x_sums = rows.reshape({m, groups, group_size}).sum(-1).contiguous();
+
+  const float* x = rows.data_ptr<float>();
+  const float* xs = x_sums.data_ptr<float>();
+  const uint8_t* wp = w.data_ptr<uint8_t>();
+  const float* sp = s.data_ptr<float>();
+  const float* zp = z.data_ptr<float>();
+  float* y = out.data_ptr<float>();
+  const int64_t half_group = group_size / 2;
+  const int64_t tiles = (out_features + kRowTile - 1) / kRowTile;
+  at::parallel_for(0, tiles, 1, [&](int64_t begin, int64_t end) {
+    for (int64_t tile = begin; tile < end; ++tile) {
+      const int64_t row_end = std::min(out_features, (tile + 1) * kRowTile);
+      for (int64_t i = 0; i < m; ++i) {
+        const float* xi = x + i * width;
+        const float* xsi = xs + i * groups;
+        for (int64_t n = tile * kRowTile; n < row_end; ++n) {
+          const uint8_t* wn = wp + n * (width / 2);
+          float acc = 0.0f;
+          for (int64_t g = 0; g < groups; ++g) {
+            const uint8_t* wg = wn + g * half_group;
+            const float* xg = xi + g * group_size;
+            float group_acc = 0.0f;
+            for (int64_t j = 0; j < half_group; ++j) {
+              const uint8_t packed = wg[j];
+              group_acc += xg[2 * j] * static_cast<float>(packed & 0x0F) +
+                           xg[2 * j + 1] * static_cast<float>(packed >> 4);
+            }
+            const int64_t sg = n * groups + g;
+            acc += sp[sg] * (group_acc - zp[sg] * xsi[g]);
+          }
+          y[i * out_features + n] = acc + (bp != nullptr ? bp[n] : 0.0f);
+        }
+      }
+    }
+  });
+  return finish_linear(out, input, out_features);
+}
+
+}  // namespace qwen3
+
+TORCH_LIBRARY_FRAGMENT(qwen, m) {
+  m.def("int8_linear(Tensor input, Tensor qweight, Tensor scale, Tensor? bias) -> Tensor");
+  m.def(
+      "int4_linear(Tensor input, Tensor qweight, Tensor scales, Tensor zeros, int group_size, "
+      "Tensor? bias) -> Tensor");
+}
+
+TORCH_LIBRARY_IMPL(qwen, CPU, m) {
+  m.impl("int8_linear", &qwen3::int8_linear);
+  m.impl("int4_linear", &qwen3::int4_linear);
+}
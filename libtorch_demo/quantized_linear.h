@@ -0,0 +1,30 @@
+#pragma once
+
+#include <ATen/ATen.h>
+
+#include <c10/util/Optional.h>
+
+namespace qwen3 {
+
+// Weight-only int8 linear: input @ (qweight * scale[:, None]).T + bias.
+// qweight is int8 [out_features, in_features] and scale fp32 [out_features];
+// weights are dequantized inside the dot-product loop and never expanded.
+// Registered for TorchScript as qwen::int8_linear.
+at::Tensor int8_linear(const at::Tensor& input,
+                       const at::Tensor& qweight,
+                       const at::Tensor& scale,
+                       const c10::optional<at::Tensor>& bias);
+
+// Weight-only 4-bit linear with group-wise affine quantization. qweight is
+// uint8 [out_features, in_features / 2] holding two 4-bit values per byte (even
+// column in the low nibble); scales and zeros are [out_features,
+// in_features / group_size], and w = (q - zero) * scale. Registered for
+// TorchScript as qwen::int4_linear.
+at::Tensor int4_linear(const at::Tensor& input,
+                       const at::Tensor& qweight,
+                       const at::Tensor& scales,
+                       const at::Tensor& zeros,
+                       int64_t group_size,
+                       const c10::optional<at::Tensor>& bias);
+
+}  // namespace qwen3
@@ -0,0 +1,181 @@
+"""Python definitions of the qwen:: custom operators.
+
+qwen3_infer registers the optimized C++ kernels under the same schemas
+(qwen3_ops.cpp, quantized_linear.cpp, bf16_weights.cpp, int8_kv_cache.cpp,
+paged_kv_cache.cpp, vector_ops.cpp).
+The reference implementations here only exist so that torch.jit.trace can
+record calls to them while exporting.
+"""
+
+import torch
+
+_LIB = torch.library.Library("qwen", "DEF")
+
+_LIB.define("lm_head_argmax(Tensor hidden, Tensor weight) -> Tensor")
+_LIB.define("int8_linear(Tensor input, Tensor qweight, Tensor scale, Tensor? bias) -> Tensor")
+_LIB.define("bf16_linear(Tensor input, Tensor weight, Tensor? bias) -> Tensor")
+_LIB.define("bf16_embedding(Tensor input_ids, Tensor weight) -> Tensor")
+_LIB.define(
+    "int4_linear(Tensor input, Tensor qweight, Tensor scales, Tensor zeros, int group_size, "
+    "Tensor? bias) -> Tensor"
+)
+_LIB.define("quantize_kv(Tensor input) -> Tensor")
+_LIB.define(
+    "int8_kv_attention(Tensor query, Tensor key, Tensor value, Tensor? attention_mask, "
+    "float scaling) -> Tensor"
+)
+_LIB.define(
+    "paged_attention(Tensor query, Tensor key, Tensor value, Tensor key_pages, "
+    "Tensor value_pages, Tensor block_tables, Tensor context_lens, float scaling) -> Tensor"
+)
+_LIB.define("vec_linear(Tensor input, Tensor weight, Tensor? bias) -> Tensor")
+_LIB.define("rms_norm(Tensor input, Tensor weight, float eps) -> Tensor")
+_LIB.define("silu_mul(Tensor gate, Tensor up) -> Tensor")
+_LIB.define("softmax_lastdim(Tensor input) -> Tensor")
+_LIB.define("rope(Tensor input, Tensor cos, Tensor sin) -> Tensor")
+
+
+def _lm_head_argmax(hidden: torch.Tensor, weight: torch.Tensor) -> torch.Tensor:
+    logits = torch.matmul(hidden.to(torch.float32), weight.to(torch.float32).t())
+    return logits.argmax(-1)
+
+
+_LIB.impl("lm_head_argmax", _lm_head_argmax, "CPU")
+
+
+def _int8_linear(
+    input: torch.Tensor, qweight: torch.Tensor, scale: torch.Tensor, bias: torch.Tensor | None
+) -> torch.Tensor:
+    weight = qweight.to(torch.float32) * scale.to(torch.float32).unsqueeze(1)
+    return torch.nn.functional.linear(input, weight.to(input.dtype), bias)
+
+
+_LIB.impl("int8_linear", _int8_linear, "CPU")
+
+
+def _int4_linear(
+    input: torch.Tensor,
+    qweight: torch.Tensor,
+    scales: torch.Tensor,
+    zeros: torch.Tensor,
+    group_size: int,
+    bias: torch.Tensor | None,
+) -> torch.Tensor:
+    out_features = qweight.size(0)
+    q = torch.stack([qweight & 0xF, qweight >> 4], dim=-1).reshape(out_features, -1, group_size)
+    q = q.to(torch.float32) - zeros.to(torch.float32).unsqueeze(-1)
+    weight = (q * scales.to(torch.float32).unsqueeze(-1)).reshape(out_features, -1)
+    return torch.nn.functional.linear(input, weight.to(input.dtype), bias)
+
+
+_LIB.impl("int4_linear", _int4_linear, "CPU")
+
+
+def _bf16_linear(
+    input: torch.Tensor, weight: torch.Tensor, bias: torch.Tensor | None
+) -> torch.Tensor:
+    return torch.nn.functional.linear(input, weight.to(input.dtype), bias)
+
+
+def _bf16_embedding(input_ids: torch.Tensor, weight: torch.Tensor) -> torch.Tensor:
+    return torch.nn.functional.embedding(input_ids, weight).to(torch.float32)
+
+
+_LIB.impl("bf16_linear", _bf16_linear, "CPU")
+_LIB.impl("bf16_embedding", _bf16_embedding, "CPU")
+
+
+def _quantize_kv(input: torch.Tensor) -> torch.Tensor:
+    x = input.to(torch.float32)
+    scale = x.abs().amax(-1, keepdim=True) / 127
+    q = torch.where(scale > 0, x / scale, torch.zeros_like(x)).round().clamp(-127, 127)
+    return torch.cat([q.to(torch.int8), scale.contiguous().view(torch.int8)], dim=-1)
+
+
+def _dequantize_kv(packed: torch.Tensor) -> torch.Tensor:
+    scale = packed[..., -4:].contiguous().view(torch.float32)
+    return packed[..., :-4].to(torch.float32) * scale
+
+
+def _int8_kv_attention(
+    query: torch.Tensor,
+    key: torch.Tensor,
+    value: torch.Tensor,
+    attention_mask: torch.Tensor | None,
+    scaling: float,
+) -> torch.Tensor:
+    groups = query.size(1) // key.size(1)
+    keys = _dequantize_kv(key).repeat_interleave(groups, dim=1)
+    values = _dequantize_kv(value).repeat_interleave(groups, dim=1)
+    scores = torch.matmul(query.to(torch.float32), keys.transpose(2, 3)) * scaling
+    if attention_mask is not None:
+        scores = scores + attention_mask.to(torch.float32)
+    output = torch.matmul(torch.softmax(scores, dim=-1), values)
+    return output.to(query.dtype)
+
+
+_LIB.impl("quantize_kv", _quantize_kv, "CPU")
+_LIB.impl("int8_kv_attention", _int8_kv_attention, "CPU")
+
+
+def _paged_attention(
+    query: torch.Tensor,
+    key: torch.Tensor,
+    value: torch.Tensor,
+    key_pages: torch.Tensor,
+    value_pages: torch.Tensor,
+    block_tables: torch.Tensor,
+    context_lens: torch.Tensor,
+    scaling: float,
+) -> torch.Tensor:
+    page_tokens = key_pages.size(2)
+    groups = query.size(1) // key.size(1)
+    outputs = []
+    for row in range(query.size(0)):
+        length = int(context_lens[row])
+        pages = block_tables[row, : -(-length // page_tokens)].long()
+
+        def gather(cache: torch.Tensor, new: torch.Tensor) -> torch.Tensor:
+            past = cache[pages].transpose(0, 1).reshape(cache.size(1), -1, cache.size(3))
+            full = torch.cat([past[:, :length].to(torch.float32), new[row].to(torch.float32)], 1)
+            return full.repeat_interleave(groups, dim=0)
+
+        keys = gather(key_pages, key)
+        values = gather(value_pages, value)
+        scores = torch.matmul(query[row].to(torch.float32), keys.transpose(1, 2)) * scaling
+        outputs.append(torch.matmul(torch.softmax(scores, dim=-1), values))
+    return torch.stack(outputs).to(query.dtype)
+
+
+_LIB.impl("paged_attention", _paged_attention, "CPU")
+
+
+def _vec_linear(input: torch.Tensor, weight: torch.Tensor, bias: torch.Tensor | None) -> torch.Tensor:
+    return torch.nn.functional.linear(input, weight, bias)
+
+
+def _rms_norm(input: torch.Tensor, weight: torch.Tensor, eps: float) -> torch.Tensor:
+    x = input.to(torch.float32)
+    x = x * torch.rsqrt(x.pow(2).mean(-1, keepdim=True) + eps)
+    return (x * weight.to(torch.float32)).to(input.dtype)
+
+
+def _silu_mul(gate: torch.Tensor, up: torch.Tensor) -> torch.Tensor:
+    return torch.nn.functional.silu(gate) * up
+
+
+def _softmax_lastdim(input: torch.Tensor) -> torch.Tensor:
+    return torch.softmax(input.to(torch.float32), dim=-1).to(input.dtype)
+
+
+def _rope(input: torch.Tensor, cos: torch.Tensor, sin: torch.Tensor) -> torch.Tensor:
+    half = input.size(-1) // 2
+    rotated = torch.cat([-input[..., half:], input[..., :half]], dim=-1)
+    return input * cos.unsqueeze(1) + rotated * sin.unsqueeze(1)
+
+
+_LIB.impl("vec_linear", _vec_linear, "CPU")
+_LIB.impl("rms_norm", _rms_norm, "CPU")
+_LIB.impl("silu_mul", _silu_mul, "CPU")
+_LIB.impl("softmax_lastdim", _softmax_lastdim, "CPU")
+_LIB.impl("rope", _rope, "CPU")
@@ -1,10 +1,23 @@
 #include <torch/script.h>
+#include <ATen/Parallel.h>
 #include <torch/csrc/autograd/profiler.h>
 
+#include "batching.h"
+#include "generation.h"
+#include "model.h"
+#include "server.h"
+#include "vector_kernels.h"
+#include "vector_ops.h"
+
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <unordered_map>
@@ -31,6 +44,33 @@ std::vector<int64_t> load_tokens(const std::string& path) {
   return tokens;
 }
 
+// Non-empty lines of path as prompts; lines receives each one's 0-based line
+// number, so outputs keep the input's numbering across blank lines.
+std::vector<std::vector<int64_t>> load_prompts(const std::string& path, std::vector<size_t>& lines) {
+  std::ifstream stream(path);
+  if (!stream.is_open()) {
+    throw std::runtime_error("Failed to open prompts file: " + path);
+  }
+  std::vector<std::vector<int64_t>> prompts;
+  std::string line;
+  for (size_t number = 0; std::getline(stream, line); ++number) {
+    std::istringstream line_stream(line);
+    std::vector<int64_t> tokens;
+    int64_t value;
+    while (line_stream >> value) {
+      tokens.push_back(value);
+    }
+    if (!tokens.empty()) {
+      prompts.push_back(std::move(tokens));
+      lines.push_back(number);
+    }
+  }
+  if (prompts.empty()) {
+    throw std::runtime_error("Prompts file is empty: " + path);
+  }
+  return prompts;
+}
+
 void write_tokens(const std::vector<int64_t>& tokens, const std::string& path) {
   std::ofstream out(path);
   if (!out.is_open()) {
@@ -45,6 +85,118 @@ void write_tokens(const std::vector<int64_t>& tokens, const std::string& path) {
   out << '\n';
 }
 
+// Writes the output file incrementally: the prompt up front, then every
+// generated token flushed as soon as it is produced, so a reader on a pipe or
+// FIFO sees tokens live. The finished file matches write_tokens.
+class TokenStreamWriter {
+ public:
+  TokenStreamWriter(const std::string& path, const std::vector<int64_t>& prompt) : out_(path) {
+    if (!out_.is_open()) {
+      throw std::runtime_error("Failed to open output file: " + path);
+    }
+    for (size_t i = 0; i < prompt.size(); ++i) {
+      if (i != 0) {
+        out_ << ' ';
+      }
+      out_ << prompt[i];
+    }
+    out_.flush();
+  }
+
+  void append(int64_t token) { out_ << ' ' << token << std::flush; }
+  void finish() { out_ << '\n' << std::flush; }
+
+ private:
+  std::ofstream out_;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ms(Clock::time_point from, Clock::time_point to) {
+  return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+struct TimingReport {
+  double load_ms = 0.0;
+  // Prompt submission to first generated token (TTFT).
+  double prefill_ms = 0.0;
+  // Gap between consecutive generated tokens.
+  std::vector<double> decode_ms;
+  double total_ms = 0.0;
+  size_t generated = 0;
+};
+
+// Nearest-rank percentile of an ascending-sorted sample.
+double percentile(const std::vector<double>& sorted, double p) {
+  const size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * static_cast<double>(sorted.size())));
+  return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+void print_timing_report(const TimingReport& report) {
+  const size_t generated = report.generated;
+  std::cout << "\nTiming" << std::endl;
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "  model load:        " << report.load_ms << " ms" << std::endl;
+  // --batch times the whole batch only.
+  if (report.prefill_ms > 0.0) {
+    std::cout << "  prefill (TTFT):    " << report.prefill_ms << " ms" << std::endl;
+  }
+  if (!report.decode_ms.empty()) {
+    std::vector<double> sorted = report.decode_ms;
+    std::sort(sorted.begin(), sorted.end());
+    std::cout << "  decode per token:  p50 " << percentile(sorted, 50) << " ms, p90 "
+              << percentile(sorted, 90) << " ms, p99 " << percentile(sorted, 99) << " ms ("
+              << sorted.size() << " steps)" << std::endl;
+  }
+  if (report.total_ms > 0.0) {
+    std::cout << "  throughput:        " << 1000.0 * static_cast<double>(generated) / report.total_ms
+              << " tokens/s (" << generated << " tokens in " << report.total_ms << " ms)"
+              << std::endl;
+  }
+}
+
+// Decode timing of the same prompt on the model loaded without any weight
+// transform, for --compare-stock.
+struct StockRun {
+  std::vector<int64_t> tokens;
+  std::vector<double> decode_ms;
+};
+
+// Tokens generated on each model right after it loads and before its timed
+// --compare-stock run, so both runs see a warm allocator, warm caches and,
+// with --mmap, weights already in the page cache.
+constexpr int kWarmupTokens = 4;
+
+void print_stock_comparison(const StockRun& stock,
+                            const TimingReport& report,
+                            const std::vector<int64_t>& tokens) {
+  if (stock.decode_ms.empty() || report.decode_ms.empty()) {
+    std::cout << "  vs stock:          no decode steps to compare" << std::endl;
+    return;
+  }
+  // An early EOS in one run would compare medians over different lengths;
+  // only the steps both runs decoded are compared.
+  const size_t steps = std::min(stock.decode_ms.size(), report.decode_ms.size());
+  std::vector<double> stock_sorted(stock.decode_ms.begin(), stock.decode_ms.begin() + steps);
+  std::sort(stock_sorted.begin(), stock_sorted.end());
+  std::vector<double> sorted(report.decode_ms.begin(), report.decode_ms.begin() + steps);
+  std::sort(sorted.begin(), sorted.end());
+  const double stock_p50 = percentile(stock_sorted, 50);
+  const double p50 = percentile(sorted, 50);
+  std::cout << "  stock decode:      p50 " << stock_p50 << " ms, p90 " << percentile(stock_sorted, 90)
+            << " ms (first " << steps << " steps of both runs)" << std::endl;
+  std::cout << "  speedup vs stock:  " << stock_p50 / p50 << "x per token (p50 " << p50
+            << " ms over the same steps)" << std::endl;
+
+  // Reordered fp32 sums can flip a near-tied greedy pick; after that the two
+  // runs decode different text and the timings compare different work.
+  const auto mismatch = std::mismatch(tokens.begin(), tokens.end(), stock.tokens.begin(), stock.tokens.end());
+  if (mismatch.first != tokens.end() || mismatch.second != stock.tokens.end()) {
+    std::cerr << "[warn] output differs from the stock path at token "
+              << (mismatch.first - tokens.begin()) << std::endl;
+  }
+}
+
 struct KernelStat {
   double total_us = 0.0;
   double self_us = 0.0;
@@ -164,28 +316,378 @@ void print_kernel_stats(const std::unordered_map<std::string, KernelStat>& stats
   std::cout << "Self time total: " << std::fixed << std::setprecision(2) << total_time
             << " us" << std::endl;
 }
+
+enum class Mode { kRun, kBatch, kServe, kConnect, kCheckKernels };
+
+struct InferOptions {
+  Mode mode = Mode::kRun;
+  std::string socket_path;
+  qwen3::ServerOptions server;
+  bool stream = false;
+  bool profile = true;
+  qwen3::LoadOptions load;
+  std::string model_path;
+  std::string input_tokens_path;
+  std::string output_tokens_path;
+  qwen3::GenerationOptions generation;
+  std::string prefix_cache_dir;
+  // Size cap of prefix_cache_dir in bytes; 0 = unlimited.
+  uint64_t prefix_cache_max_bytes = uint64_t{1024} << 20;
+  // Kernel table name; empty picks one for the CPU.
+  std::string kernels;
+  // Run the prompt on the stock model first and report the speedup.
+  bool compare_stock = false;
+};
+
+void print_usage(const char* argv0) {
+  std::cerr << "Usage: " << argv0
+            << " [options] <torchscript_model> <input_tokens.txt> <output_tokens.txt>"
+               " [max_new_tokens] [eos_token]\n"
+            << "       " << argv0
+            << " [options] --batch <prompts.txt> <torchscript_model> <output_dir>"
+               " [max_new_tokens] [eos_token]\n"
+            << "       " << argv0
+            << " [options] --serve <socket> <torchscript_model> [max_new_tokens] [eos_token]\n"
+            << "       " << argv0
+            << " --connect <socket> <input_tokens.txt> <output_tokens.txt> [max_new_tokens]\n"
+            << "       " << argv0 << " --check-kernels\n"
+            << "Sampling options (default: greedy):\n"
+            << "  --temperature T         Sample with temperature T (0 = greedy)\n"
+            << "  --top-k K               Keep the K most likely tokens (0 = off)\n"
+            << "  --top-p P               Keep the smallest set with mass >= P (1 = off)\n"
+            << "  --min-p P               Drop tokens below P * max probability (0 = off)\n"
+            << "  --repetition-penalty R  Penalize tokens already in the sequence (1 = off)\n"
+            << "  --seed S                RNG seed for sampling\n"
+            << "Cache options:\n"
+            << "  --kv-cache DTYPE        KV cache storage: float (default) or int8 with\n"
+            << "                          per-head, per-token scales\n"
+            << "  --kv-pages N            Keep --batch/--max-batch KV caches in a pool of N\n"
+            << "                          16-token pages (0 = padded tensors, the default)\n"
+            << "  --prefix-cache DIR      Reuse and store prompt KV caches in DIR across runs\n"
+            << "  --prefix-cache-max-mb N Evict the least recently used prefix blocks beyond N MiB\n"
+            << "                          (default 1024, 0 = unlimited)\n"
+            << "Load options:\n"
+            << "  --mmap                  Map the (uncompressed) model file and use its weights in place\n"
+            << "  --pack-weights          Repack linear weights into GEMV panels (cached as MODEL.packed)\n"
+            << "  --bf16-weights          Store fp32 weights as bf16, computing in fp32\n"
+            << "  --xnnpack               Run fp32 linears as XNNPACK prepacked linear ops; the packed\n"
+            << "                          weights replace the fp32 ones (about the fp32 model size),\n"
+            << "                          and loading peaks at the model plus one weight\n"
+            << "  --compare-stock         First decode the prompt without --pack-weights/--bf16-weights/\n"
+            << "                          --xnnpack and report the per-token speedup over it (both\n"
+            << "                          models are warmed up first)\n"
+            << "Output options:\n"
+            << "  --stream                Write each token to the output file as it is produced\n"
+            << "  --no-profile            Skip the kernel profiler (keeps the timing report clean)\n"
+            << "Batch options:\n"
+            << "  --batch PROMPTS         Run every line of PROMPTS as one padded batch and write\n"
+            << "                          output_dir/<line>.txt per prompt (blank lines are skipped)\n"
+            << "Server options:\n"
+            << "  --serve SOCKET          Keep the model loaded and serve requests on SOCKET\n"
+            << "  --max-batch N           Decode up to N server requests together (default 1)\n"
+            << "  --workers N             Fork N server processes sharing the loaded weights\n"
+            << "  --threads-per-worker T  Intra-op threads per worker (default: CPUs / workers)\n"
+            << "  --connect SOCKET        Send the prompt to a running server\n"
+            << "                          (sampling options belong to the --serve process)\n"
+            << "Kernel options:\n"
+            << "  --kernels NAME          Force a vector kernel table (scalar, rvv128, rvv256, rvv512);\n"
+            << "                          default: $QWEN3_KERNELS, else picked from the CPU's V/VLEN\n"
+            << "  --check-kernels         Compare every usable kernel table with ATen and exit\n";
+}
+
+InferOptions parse_options(int argc, const char* argv[]) {
+  InferOptions options;
+  qwen3::SamplingConfig& sampling = options.generation.sampling;
+  // Last sampling option given; the server samples with its own.
+  std::string sampling_option;
+  std::vector<std::string> positional;
+  if (const char* kernels = std::getenv("QWEN3_KERNELS")) {
+    options.kernels = kernels;
+  }
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.size() < 3 || arg.compare(0, 2, "--") != 0) {
+      positional.push_back(arg);
+      continue;
+    }
+    auto value = [&]() -> std::string {
+      if (i + 1 >= argc) {
+        throw std::invalid_argument("Missing value for " + arg);
+      }
+      return argv[++i];
+    };
+    if (arg == "--temperature" || arg == "--top-k" || arg == "--top-p" || arg == "--min-p" ||
+        arg == "--repetition-penalty" || arg == "--seed") {
+      sampling_option = arg;
+    }
+    if (arg == "--temperature") {
+      sampling.temperature = std::stof(value());
+    } else if (arg == "--top-k") {
+      sampling.top_k = std::stoll(value());
+    } else if (arg == "--top-p") {
+      sampling.top_p = std::stof(value());
+    } else if (arg == "--min-p") {
+      sampling.min_p = std::stof(value());
+    } else if (arg == "--repetition-penalty") {
+      sampling.repetition_penalty = std::stof(value());
+    } else if (arg == "--seed") {
+      sampling.seed = std::stoull(value());
+    } else if (arg == "--kv-cache") {
+      options.generation.kv_cache = qwen3::parse_kv_cache_dtype(value());
+    } else if (arg == "--kv-pages") {
+      options.generation.kv_pages = std::stoll(value());
+      if (options.generation.kv_pages < 0) {
+        throw std::invalid_argument("--kv-pages must be >= 0");
+      }
+    } else if (arg == "--prefix-cache") {
+      options.prefix_cache_dir = value();
+    } else if (arg == "--prefix-cache-max-mb") {
+      const int64_t megabytes = std::stoll(value());
+      if (megabytes < 0) {
+        throw std::invalid_argument("--prefix-cache-max-mb must be >= 0");
+      }
+      options.prefix_cache_max_bytes = static_cast<uint64_t>(megabytes) << 20;
+    } else if (arg == "--mmap") {
+      options.load.map_weights = true;
+    } else if (arg == "--pack-weights") {
+      options.load.pack_weights = true;
+    } else if (arg == "--bf16-weights") {
+      options.load.bf16_weights = true;
+    } else if (arg == "--xnnpack") {
+      options.load.xnnpack_linear = true;
+    } else if (arg == "--compare-stock") {
+      options.compare_stock = true;
+    } else if (arg == "--stream") {
+      options.stream = true;
+    } else if (arg == "--no-profile") {
+      options.profile = false;
+    } else if (arg == "--batch") {
+      options.mode = Mode::kBatch;
+      options.input_tokens_path = value();
+    } else if (arg == "--serve") {
+      options.mode = Mode::kServe;
+      options.socket_path = value();
+    } else if (arg == "--max-batch") {
+      options.server.max_batch = std::stoll(value());
+      if (options.server.max_batch < 1) {
+        throw std::invalid_argument("--max-batch must be >= 1");
+      }
+    } else if (arg == "--workers") {
+      options.server.workers = std::stoll(value());
+      if (options.server.workers < 1) {
+        throw std::invalid_argument("--workers must be >= 1");
+      }
+    } else if (arg == "--threads-per-worker") {
+      options.server.threads_per_worker = std::stoll(value());
+      if (options.server.threads_per_worker < 0) {
+        throw std::invalid_argument("--threads-per-worker must be >= 0");
+      }
+    } else if (arg == "--connect") {
+      options.mode = Mode::kConnect;
+      options.socket_path = value();
+    } else if (arg == "--kernels") {
+      options.kernels = value();
+    } else if (arg == "--check-kernels") {
+      options.mode = Mode::kCheckKernels;
+    } else {
+      throw std::invalid_argument("Unknown option: " + arg);
+    }
+  }
+
+  // Leading positional arguments depend on the mode; the optional
+  // [max_new_tokens] [eos_token] tail is shared.
+  size_t required = 0;
+  size_t optional = 2;
+  switch (options.mode) {
+    case Mode::kRun:
+      required = 3;
+      break;
+    case Mode::kBatch:
+      required = 2;
+      break;
+    case Mode::kServe:
+      required = 1;
+      break;
+    case Mode::kConnect:
+      required = 2;
+      optional = 1;
+      break;
+    case Mode::kCheckKernels:
+      optional = 0;
+      break;
+  }
+  if (positional.size() < required || positional.size() > required + optional) {
+    throw std::invalid_argument("Expected " + std::to_string(required) + " to " +
+                                std::to_string(required + optional) +
+                                " positional arguments");
+  }
+  if (options.compare_stock && options.mode != Mode::kRun) {
+    throw std::invalid_argument("--compare-stock only applies to single-prompt runs");
+  }
+  if (!sampling_option.empty() && options.mode == Mode::kConnect) {
+    throw std::invalid_argument(sampling_option +
+                                " cannot be used with --connect; pass it to the --serve process");
+  }
+  if (options.stream && options.mode != Mode::kRun) {
+    throw std::invalid_argument("--stream only applies to single-prompt runs");
+  }
+  if (!options.profile && (options.mode == Mode::kServe || options.mode == Mode::kConnect)) {
+    throw std::invalid_argument("--no-profile only applies to single-prompt and --batch runs");
+  }
+  if (options.mode == Mode::kCheckKernels) {
+    return options;
+  }
+  size_t next = 0;
+  if (options.mode != Mode::kConnect) {
+    options.model_path = positional[next++];
+  }
+  if (options.mode == Mode::kRun || options.mode == Mode::kConnect) {
+    options.input_tokens_path = positional[next++];
+  }
+  if (options.mode != Mode::kServe) {
+    options.output_tokens_path = positional[next++];
+  }
+  if (positional.size() > next) {
+    options.generation.max_new_tokens = std::stoi(positional[next++]);
+  }
+  if (positional.size() > next) {
+    options.generation.eos_token = std::stoll(positional[next++]);
+  }
+  return options;
+}
+
+int run_client_mode(const InferOptions& options) {
+  const std::vector<int64_t> prompt_tokens = load_tokens(options.input_tokens_path);
+  const int max_new_tokens = std::max(options.generation.max_new_tokens, 0);
+  std::vector<int64_t> tokens = prompt_tokens;
+  const std::vector<int64_t> generated = qwen3::run_client(
+      options.socket_path, prompt_tokens, static_cast<uint32_t>(max_new_tokens));
+  tokens.insert(tokens.end(), generated.begin(), generated.end());
+  write_tokens(tokens, options.output_tokens_path);
+  std::cout << "Generated " << tokens.size() << " tokens." << std::endl;
+  return 0;
+}
+
+void warm_up(qwen3::Qwen3Model& model,
+             const std::vector<int64_t>& prompt_tokens,
+             qwen3::GenerationOptions generation) {
+  generation.max_new_tokens = std::min(generation.max_new_tokens, kWarmupTokens);
+  generation.prefix_cache = nullptr;
+  torch::NoGradGuard guard;
+  qwen3::generate(model, prompt_tokens, generation);
+}
+
+// Loads the model with only --mmap, warms it up and decodes the prompt once.
+// The model is released before the main run loads its own copy.
+StockRun run_stock(const InferOptions& options, const std::vector<int64_t>& prompt_tokens) {
+  qwen3::LoadOptions load;
+  load.map_weights = options.load.map_weights;
+  qwen3::Qwen3Model model = qwen3::Qwen3Model::load(options.model_path, load);
+  warm_up(model, prompt_tokens, options.generation);
+  torch::NoGradGuard guard;
+  StockRun run;
+  Clock::time_point last_token_time;
+  bool first_token = true;
+  run.tokens = qwen3::generate(model, prompt_tokens, options.generation, [&](int64_t) {
+    const Clock::time_point now = Clock::now();
+    if (!first_token) {
+      run.decode_ms.push_back(elapsed_ms(last_token_time, now));
+    }
+    first_token = false;
+    last_token_time = now;
+  });
+  return run;
+}
 }  // namespace
 
 int main(int argc, const char* argv[]) {
-  if (argc < 4) {
-    std::cerr << "Usage: " << argv[0]
-              << " <torchscript_model> <input_tokens.txt> <output_tokens.txt> [max_new_tokens] [eos_token]" << std::endl;
+  InferOptions options;
+  try {
+    options = parse_options(argc, argv);
+  } catch (const std::exception& ex) {
+    std::cerr << "Error: " << ex.what() << std::endl;
+    print_usage(argv[0]);
     return 1;
   }
 
-  const std::string model_path = argv[1];
-  const std::string input_tokens_path = argv[2];
-  const std::string output_tokens_path = argv[3];
-  const int max_new_tokens = argc >= 5 ? std::stoi(argv[4]) : 64;
-  const int64_t eos_token = argc >= 6 ? std::stoll(argv[5]) : -1;
-
   try {
-    std::vector<int64_t> prompt_tokens = load_tokens(input_tokens_path);
+    if (options.mode == Mode::kConnect) {
+      return run_client_mode(options);
+    }
+    const qwen3::kernels::KernelTable& kernels = qwen3::kernels::select_kernels(options.kernels);
+    const qwen3::kernels::VectorSupport vector_support = qwen3::kernels::detect_vector_support();
+    std::cerr << "[kernels] " << kernels.name << (options.kernels.empty() ? "" : " (forced)") << "; CPU "
+              << (vector_support.rvv ? "VLEN " + std::to_string(vector_support.vlen) : std::string("without V"))
+              << (vector_support.isa.empty() ? "" : ", isa " + vector_support.isa) << std::endl;
+    if (options.mode == Mode::kCheckKernels) {
+      return qwen3::check_vector_ops(std::cout) ? 0 : 1;
+    }
+
+    std::vector<int64_t> prompt_tokens;
+    std::vector<std::vector<int64_t>> batch_prompts;
+    std::vector<size_t> batch_lines;
+    if (options.mode == Mode::kRun) {
+      prompt_tokens = load_tokens(options.input_tokens_path);
+    } else if (options.mode == Mode::kBatch) {
+      batch_prompts = load_prompts(options.input_tokens_path, batch_lines);
+    }
 
-    torch::jit::Module module = torch::jit::load(model_path);
-    module.eval();
+    std::unique_ptr<StockRun> stock;
+    if (options.compare_stock) {
+      std::cout << "Decoding on the stock model for comparison" << std::endl;
+      stock = std::make_unique<StockRun>(run_stock(options, prompt_tokens));
+    }
+
+    // Forked server workers must not inherit a started OpenMP pool: load and
+    // run the load-time weight passes single-threaded, and let each worker
+    // set its own count (see run_server).
+    if (options.mode == Mode::kServe && options.server.workers > 1) {
+      at::set_num_threads(1);
+    }
+
+    TimingReport timing;
+    const Clock::time_point load_start = Clock::now();
+    qwen3::Qwen3Model model = qwen3::Qwen3Model::load(options.model_path, options.load);
+    timing.load_ms = elapsed_ms(load_start, Clock::now());
+    qwen3::check_sampling_supported(model.config(), options.generation.sampling);
+    qwen3::check_kv_cache_supported(model.config(), options.generation.kv_cache);
+    if (stock) {
+      warm_up(model, prompt_tokens, options.generation);
+    }
+    if (!options.prefix_cache_dir.empty()) {
+      options.generation.prefix_cache = std::make_shared<qwen3::PrefixCache>(
+          options.prefix_cache_dir, options.model_path, model.config(), options.load,
+          options.prefix_cache_max_bytes);
+    }
 
     torch::NoGradGuard guard;
+    if (options.mode == Mode::kServe) {
+      qwen3::run_server(model, options.socket_path, options.generation, options.server);
+      return 0;
+    }
+
+    std::unique_ptr<TokenStreamWriter> stream;
+    if (options.stream) {
+      stream = std::make_unique<TokenStreamWriter>(options.output_tokens_path, prompt_tokens);
+    }
+    Clock::time_point generation_start;
+    Clock::time_point last_token_time;
+    bool first_token = true;
+    const qwen3::TokenCallback on_token = [&](int64_t token) {
+      const Clock::time_point now = Clock::now();
+      if (first_token) {
+        timing.prefill_ms = elapsed_ms(generation_start, now);
+        first_token = false;
+      } else {
+        timing.decode_ms.push_back(elapsed_ms(last_token_time, now));
+      }
+      last_token_time = now;
+      timing.generated += 1;
+      if (stream) {
+        stream->append(token);
+      }
+    };
+
     torch::autograd::profiler::thread_event_lists profiler_events;
 
     torch::profiler::impl::ProfilerConfig profiler_cfg(
@@ -197,40 +699,57 @@ int main(int argc, const char* argv[]) {
         /*with_modules=*/false);
 
     {
-      torch::autograd::profiler::TLSLegacyProfilerGuard profiler_guard(
-          profiler_cfg,
-          [&](const torch::autograd::profiler::thread_event_lists& lists) {
-            profiler_events = lists;
-          });
-
-      torch::Tensor input = torch::tensor(
-                                  prompt_tokens,
-                                  torch::TensorOptions().dtype(torch::kLong))
-                                 .unsqueeze(0);
-      torch::Tensor attention_mask = torch::ones_like(input);
-
-      for (int step = 0; step < max_new_tokens; ++step) {
-        std::vector<torch::jit::IValue> inputs;
-        inputs.emplace_back(input);
-        inputs.emplace_back(attention_mask);
-        torch::Tensor logits = module.forward(inputs).toTensor();
-        torch::Tensor logits_last = logits.index({0, -1});
-        torch::Tensor next_token_tensor = logits_last.argmax().toType(torch::kLong);
-        int64_t next_token = next_token_tensor.item<int64_t>();
-
-        input = torch::cat({input, next_token_tensor.view({1, 1})}, 1);
-        attention_mask = torch::cat(
-            {attention_mask, torch::ones({1, 1}, attention_mask.options())}, 1);
-        prompt_tokens.push_back(next_token);
-        if (eos_token >= 0 && next_token == eos_token) {
-          break;
+      std::unique_ptr<torch::autograd::profiler::TLSLegacyProfilerGuard> profiler_guard;
+      if (options.profile) {
+        profiler_guard = std::make_unique<torch::autograd::profiler::TLSLegacyProfilerGuard>(
+            profiler_cfg,
+            [&](const torch::autograd::profiler::thread_event_lists& lists) {
+              profiler_events = lists;
+            });
+      }
+
+      generation_start = Clock::now();
+      if (options.mode == Mode::kBatch) {
+        size_t prompt_total = 0;
+        for (const std::vector<int64_t>& prompt : batch_prompts) {
+          prompt_total += prompt.size();
         }
+        batch_prompts = qwen3::generate_batch(model, batch_prompts, options.generation);
+        for (const std::vector<int64_t>& sequence : batch_prompts) {
+          timing.generated += sequence.size();
+        }
+        timing.generated -= prompt_total;
+      } else {
+        prompt_tokens = qwen3::generate(model, prompt_tokens, options.generation, on_token);
       }
+      timing.total_ms = elapsed_ms(generation_start, Clock::now());
     }
 
-    write_tokens(prompt_tokens, output_tokens_path);
-    std::cout << "Generated " << prompt_tokens.size() << " tokens." << std::endl;
+    if (options.mode == Mode::kBatch) {
+      const std::filesystem::path output_dir(options.output_tokens_path);
+      std::filesystem::create_directories(output_dir);
+      for (size_t i = 0; i < batch_prompts.size(); ++i) {
+        write_tokens(batch_prompts[i], (output_dir / (std::to_string(batch_lines[i]) + ".txt")).string());
+      }
+      std::cout << "Generated " << batch_prompts.size() << " sequences into "
+                << output_dir.string() << "." << std::endl;
+      print_timing_report(timing);
+    } else {
+      if (stream) {
+        stream->finish();
+      } else {
+        write_tokens(prompt_tokens, options.output_tokens_path);
+      }
+      std::cout << "Generated " << prompt_tokens.size() << " tokens." << std::endl;
+      print_timing_report(timing);
+      if (stock) {
+        print_stock_comparison(*stock, timing, prompt_tokens);
+      }
+    }
 
+    if (!options.profile) {
+      return 0;
+    }
     if (!profiler_events.empty()) {
       std::unordered_map<std::string, KernelStat> kernel_stats;
       aggregate_kernel_stats(profiler_events, kernel_stats);
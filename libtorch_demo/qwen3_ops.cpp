@@ -0,0 +1,91 @@
+#include "qwen3_ops.h"
+
+#include <ATen/Dispatch.h>
+#include <ATen/Parallel.h>
+#include <torch/library.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace qwen3 {
+namespace {
+// Vocab rows scored per task. 256 rows of a 1024-wide fp32 matrix is 1 MB,
+// enough work per task to amortize scheduling while leaving ~600 tiles to
+// spread across the guest's vCPUs.
+constexpr int64_t kVocabTile = 256;
+
+struct TileBest {
+  float value = -std::numeric_limits<float>::infinity();
+  int64_t index = -1;
+};
+
+template <typename scalar_t>
+int64_t argmax_row(const float* hidden, const scalar_t* weight, int64_t vocab, int64_t width) {
+  const int64_t num_tiles = (vocab + kVocabTile - 1) / kVocabTile;
+  std::vector<TileBest> tiles(num_tiles);
+
+  at::parallel_for(0, num_tiles, 1, [&](int64_t begin, int64_t end) {
+    for (int64_t tile = begin; tile < end; ++tile) {
+      TileBest best;
+      const int64_t row_end = std::min(vocab, (tile + 1) * kVocabTile);
+      for (int64_t row = tile * kVocabTile; row < row_end; ++row) {
+        const scalar_t* w = weight + row * width;
+        float acc = 0.0f;
+        for (int64_t k = 0; k < width; ++k) {
+          acc += hidden[k] * static_cast<float>(w[k]);
+        }
+        // Strict comparison keeps the first maximum, matching Tensor::argmax.
+        if (acc > best.value || best.index < 0) {
+          best.value = acc;
+          best.index = row;
+        }
+      }
+      tiles[tile] = best;
+    }
+  });
+
+  TileBest best;
+  for (const TileBest& tile : tiles) {
+    if (tile.index >= 0 && (best.index < 0 || tile.value > best.value)) {
+      best = tile;
+    }
+  }
+  return best.index;
+}
+}  // namespace
+
+at::Tensor lm_head_argmax(const at::Tensor& hidden, const at::Tensor& weight) {
+  TORCH_CHECK(weight.dim() == 2, "lm_head_argmax: weight must be 2-D, got ", weight.dim(), "-D");
+  TORCH_CHECK(hidden.dim() >= 1 && hidden.size(-1) == weight.size(1),
+              "lm_head_argmax: hidden size ", hidden.size(-1),
+              " does not match weight width ", weight.size(1));
+
+  const int64_t width = weight.size(1);
+  const int64_t vocab = weight.size(0);
+  const at::Tensor rows = hidden.reshape({-1, width}).to(at::kFloat).contiguous();
+  const at::Tensor w = weight.contiguous();
+
+  std::vector<int64_t> out_shape(hidden.sizes().begin(), hidden.sizes().end() - 1);
+  at::Tensor result = at::empty(out_shape, hidden.options().dtype(at::kLong));
+  int64_t* out = result.data_ptr<int64_t>();
+
+  AT_DISPATCH_FLOATING_TYPES_AND2(at::kBFloat16, at::kHalf, w.scalar_type(), "lm_head_argmax", [&] {
+    const float* h = rows.data_ptr<float>();
+    const scalar_t* wp = w.data_ptr<scalar_t>();
+    for (int64_t r = 0; r < rows.size(0); ++r) {
+      out[r] = argmax_row<scalar_t>(h + r * width, wp, vocab, width);
+    }
+  });
+  return result;
+}
+
+}  // namespace qwen3
+
+TORCH_LIBRARY(qwen, m) {
+  m.def("lm_head_argmax(Tensor hidden, Tensor weight) -> Tensor");
+}
+
+TORCH_LIBRARY_IMPL(qwen, CPU, m) {
+  m.impl("lm_head_argmax", &qwen3::lm_head_argmax);
+}
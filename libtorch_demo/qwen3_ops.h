@@ -0,0 +1,13 @@
+#pragma once
+
+#include <ATen/ATen.h>
+
+namespace qwen3 {
+
+// Greedy lm_head: returns argmax(hidden @ weight.T) over the vocab without
+// materializing the logits. hidden is [..., hidden_size], weight is
+// [vocab, hidden_size]; the result has hidden's leading shape and dtype long.
+// Registered for TorchScript as qwen::lm_head_argmax.
+at::Tensor lm_head_argmax(const at::Tensor& hidden, const at::Tensor& weight);
+
+}  // namespace qwen3
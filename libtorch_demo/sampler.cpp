@@ -0,0 +1,141 @@
+#include "sampler.h"
+
+#include <ATen/record_function.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace qwen3 {
+namespace {
+// Tokens whose scaled logit trails the maximum by more than this carry less
+// than e^-30 of the leader's probability; dropping them up front keeps the
+// candidate set small without changing any observable sample.
+constexpr float kNegligibleLogitGap = 30.0f;
+}  // namespace
+
+Sampler::Sampler(const SamplingConfig& config) : config_(config), rng_(config.seed) {
+  if (config_.top_k < 0) {
+    throw std::invalid_argument("top-k must be >= 0");
+  }
+  if (config_.top_p <= 0.0f || config_.top_p > 1.0f) {
+    throw std::invalid_argument("top-p must be in (0, 1]");
+  }
+  if (config_.min_p < 0.0f || config_.min_p >= 1.0f) {
+    throw std::invalid_argument("min-p must be in [0, 1)");
+  }
+  if (config_.repetition_penalty <= 0.0f) {
+    throw std::invalid_argument("repetition penalty must be > 0");
+  }
+}
+
+void Sampler::apply_repetition_penalty(float* logits, int64_t vocab, const int64_t* history,
+                                       int64_t history_len) {
+  // Each distinct token is penalized once; the marks are cleared afterwards so
+  // the vocab-sized bitmap never needs a full reset.
+  seen_.resize(static_cast<size_t>(vocab), 0);
+  for (int64_t i = 0; i < history_len; ++i) {
+    const int64_t token = history[i];
+    if (token < 0 || token >= vocab || seen_[token]) {
+      continue;
+    }
+    seen_[token] = 1;
+    float& logit = logits[token];
+    logit = logit > 0.0f ? logit / config_.repetition_penalty
+                         : logit * config_.repetition_penalty;
+  }
+  for (int64_t i = 0; i < history_len; ++i) {
+    const int64_t token = history[i];
+    if (token >= 0 && token < vocab) {
+      seen_[token] = 0;
+    }
+  }
+}
+
+double Sampler::next_uniform() {
+  // 53 random mantissa bits; independent of the standard library's
+  // distribution implementation so a seed reproduces across toolchains.
+  return static_cast<double>(rng_() >> 11) * 0x1.0p-53;
+}
+
+int64_t Sampler::sample(at::Tensor logits, const int64_t* history, int64_t history_len) {
+  RECORD_FUNCTION("qwen3::sample", std::vector<c10::IValue>({logits}));
+
+  if (logits.scalar_type() != at::kFloat || !logits.is_contiguous()) {
+    logits = logits.to(at::kFloat).contiguous();
+  }
+  float* data = logits.data_ptr<float>();
+  const int64_t vocab = logits.numel();
+
+  if (config_.repetition_penalty != 1.0f) {
+    apply_repetition_penalty(data, vocab, history, history_len);
+  }
+
+  const float* max_it = std::max_element(data, data + vocab);
+  if (config_.greedy()) {
+    return static_cast<int64_t>(max_it - data);
+  }
+
+  const float max_logit = *max_it;
+  const float temperature = config_.temperature;
+  float floor = max_logit - kNegligibleLogitGap * temperature;
+  if (config_.min_p > 0.0f) {
+    // p_i >= min_p * p_max  <=>  logit_i >= max_logit + T * ln(min_p)
+    floor = std::max(floor, max_logit + temperature * std::log(config_.min_p));
+  }
+
+  candidates_.clear();
+  for (int64_t i = 0; i < vocab; ++i) {
+    if (data[i] >= floor) {
+      candidates_.push_back({data[i], i});
+    }
+  }
+
+  auto by_logit_desc = [](const Candidate& lhs, const Candidate& rhs) {
+    return lhs.logit > rhs.logit;
+  };
+  if (config_.top_k > 0 && static_cast<int64_t>(candidates_.size()) > config_.top_k) {
+    std::nth_element(candidates_.begin(), candidates_.begin() + config_.top_k,
+                     candidates_.end(), by_logit_desc);
+    candidates_.resize(static_cast<size_t>(config_.top_k));
+  }
+  if (config_.top_p < 1.0f) {
+    std::sort(candidates_.begin(), candidates_.end(), by_logit_desc);
+  }
+
+  const int64_t count = static_cast<int64_t>(candidates_.size());
+  probs_.resize(static_cast<size_t>(count));
+  for (int64_t i = 0; i < count; ++i) {
+    probs_[i] = candidates_[i].logit / temperature;
+  }
+  at::Tensor probs = at::from_blob(probs_.data(), {count}, at::kFloat);
+  probs.copy_(at::softmax(probs, 0));
+
+  int64_t keep = count;
+  if (config_.top_p < 1.0f) {
+    double cumulative = 0.0;
+    for (int64_t i = 0; i < count; ++i) {
+      cumulative += probs_[i];
+      if (cumulative >= config_.top_p) {
+        keep = i + 1;
+        break;
+      }
+    }
+  }
+
+  double mass = 0.0;
+  for (int64_t i = 0; i < keep; ++i) {
+    mass += probs_[i];
+  }
+  const double target = next_uniform() * mass;
+  double cumulative = 0.0;
+  for (int64_t i = 0; i < keep; ++i) {
+    cumulative += probs_[i];
+    if (target < cumulative) {
+      return candidates_[i].token;
+    }
+  }
+  return candidates_[keep - 1].token;
+}
+
+}  // namespace qwen3
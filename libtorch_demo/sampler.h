@@ -0,0 +1,53 @@
+#pragma once
+
+#include <ATen/ATen.h>
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace qwen3 {
+
+struct SamplingConfig {
+  // temperature <= 0 selects greedy decoding; the remaining filters then only
+  // matter through the repetition penalty.
+  float temperature = 0.0f;
+  int64_t top_k = 0;
+  float top_p = 1.0f;
+  float min_p = 0.0f;
+  float repetition_penalty = 1.0f;
+  uint64_t seed = 0;
+
+  bool greedy() const { return temperature <= 0.0f; }
+  bool plain_argmax() const { return greedy() && repetition_penalty == 1.0f; }
+};
+
+// Picks the next token from one row of logits. Candidates are gathered with a
+// threshold pass plus nth_element instead of sorting the whole vocabulary, and
+// the softmax only runs over the survivors.
+class Sampler {
+ public:
+  explicit Sampler(const SamplingConfig& config);
+
+  // logits is the 1-D vocab row for the current position; it is modified in
+  // place by the repetition penalty. history holds every token seen so far.
+  int64_t sample(at::Tensor logits, const int64_t* history, int64_t history_len);
+
+ private:
+  struct Candidate {
+    float logit;
+    int64_t token;
+  };
+
+  void apply_repetition_penalty(float* logits, int64_t vocab, const int64_t* history,
+                                int64_t history_len);
+  double next_uniform();
+
+  SamplingConfig config_;
+  std::mt19937_64 rng_;
+  std::vector<Candidate> candidates_;
+  std::vector<float> probs_;
+  std::vector<uint8_t> seen_;
+};
+
+}  // namespace qwen3
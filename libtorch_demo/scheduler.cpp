@@ -0,0 +1,152 @@
+#include "scheduler.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+namespace qwen3 {
+
+ContinuousBatcher::ContinuousBatcher(Qwen3Model& model,
+                                     int64_t max_batch,
+                                     const GenerationOptions& cache_options)
+    : model_(model), max_batch_(max_batch) {
+  if (!model_.config().prefill_decode) {
+    throw std::runtime_error("Continuous batching requires a model exported with prefill/decode_step");
+  }
+  if (max_batch_ < 1) {
+    throw std::invalid_argument("max batch must be >= 1");
+  }
+  cache_ = make_decode_cache(model_.config(), cache_options);
+}
+
+void ContinuousBatcher::submit(GenerationRequest request) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.push_back(std::move(request));
+  }
+  pending_cv_.notify_one();
+}
+
+std::vector<GenerationRequest> ContinuousBatcher::take_pending() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (active_.empty()) {
+    pending_cv_.wait(lock, [this] { return !pending_.empty(); });
+  }
+  std::vector<GenerationRequest> admitted;
+  while (!pending_.empty() &&
+         static_cast<int64_t>(active_.size() + admitted.size()) < max_batch_) {
+    admitted.push_back(std::move(pending_.front()));
+    pending_.pop_front();
+  }
+  return admitted;
+}
+
+void ContinuousBatcher::run() {
+  torch::NoGradGuard no_grad;
+  while (true) {
+    for (GenerationRequest& request : take_pending()) {
+      admit(std::move(request));
+    }
+    if (active_.empty()) {
+      continue;
+    }
+    try {
+      step();
+    } catch (const std::exception& ex) {
+      std::cerr << "[scheduler] decode step failed: " << ex.what() << std::endl;
+      fail_all();
+    }
+  }
+}
+
+void ContinuousBatcher::admit(GenerationRequest request) {
+  const std::function<void(bool)> on_finish = request.on_finish;
+  try {
+    check_sampling_supported(model_.config(), request.options.sampling);
+    if (request.options.max_new_tokens <= 0) {
+      on_finish(true);
+      return;
+    }
+
+    const torch::Tensor tokens = torch::tensor(request.prompt, torch::kLong).unsqueeze(0);
+    const torch::Tensor mask = torch::ones_like(tokens);
+    StepOutput prefill = request.options.prefix_cache
+        ? prefill_with_prefix_cache(model_, request.prompt, request.options.kv_cache,
+                                    *request.options.prefix_cache)
+        : model_.prefill(tokens, mask, request.options.kv_cache);
+
+    Sampler sampler(request.options.sampling);
+    Sequence sequence{std::move(request), std::move(sampler), {}, 0};
+    sequence.tokens = sequence.request.prompt;
+    if (!emit(sequence, prefill.logits.index({0, -1}))) {
+      on_finish(true);
+      return;
+    }
+    cache_->add(prefill.keys, prefill.values, mask);
+    active_.push_back(std::move(sequence));
+  } catch (const std::exception& ex) {
+    std::cerr << "[scheduler] prefill failed: " << ex.what() << std::endl;
+    on_finish(false);
+  }
+}
+
+bool ContinuousBatcher::emit(Sequence& sequence, const torch::Tensor& row) {
+  const GenerationOptions& options = sequence.request.options;
+  const torch::Tensor history = torch::from_blob(
+      sequence.tokens.data(), {static_cast<int64_t>(sequence.tokens.size())}, torch::kLong);
+  const int64_t token =
+      select_token(model_.config(), options.sampling, sequence.sampler, row, history);
+  sequence.tokens.push_back(token);
+  sequence.generated += 1;
+
+  const bool consumer_alive = sequence.request.on_token(token);
+  const bool hit_eos = options.eos_token >= 0 && token == options.eos_token;
+  return consumer_alive && !hit_eos && sequence.generated < options.max_new_tokens;
+}
+
+void ContinuousBatcher::step() {
+  const int64_t batch = static_cast<int64_t>(active_.size());
+  torch::Tensor tokens = torch::empty({batch, 1}, torch::kLong);
+  torch::Tensor positions = torch::empty({batch, 1}, torch::kLong);
+  int64_t* token_data = tokens.data_ptr<int64_t>();
+  int64_t* position_data = positions.data_ptr<int64_t>();
+  for (int64_t i = 0; i < batch; ++i) {
+    token_data[i] = active_[i].tokens.back();
+    position_data[i] = static_cast<int64_t>(active_[i].tokens.size()) - 1;
+  }
+
+  const torch::Tensor logits = cache_->decode(model_, tokens, positions);
+
+  // Select every row before finishing any, so a failure part-way leaves
+  // active_ intact for fail_all.
+  std::vector<int64_t> keep;
+  std::vector<int64_t> finished;
+  keep.reserve(active_.size());
+  for (int64_t i = 0; i < batch; ++i) {
+    (emit(active_[i], logits.index({i, -1})) ? keep : finished).push_back(i);
+  }
+  if (finished.empty()) {
+    return;
+  }
+
+  for (int64_t i : finished) {
+    active_[i].request.on_finish(true);
+  }
+  std::vector<Sequence> still_active;
+  still_active.reserve(keep.size());
+  for (int64_t i : keep) {
+    still_active.push_back(std::move(active_[i]));
+  }
+  active_ = std::move(still_active);
+  cache_->retain(keep);
+}
+
+void ContinuousBatcher::fail_all() {
+  for (Sequence& sequence : active_) {
+    sequence.request.on_finish(false);
+  }
+  active_.clear();
+  cache_->retain({});
+}
+
+}  // namespace qwen3
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "batching.h"
+#include "generation.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace qwen3 {
+
+// One generation request handed to the scheduler. on_token returns false once
+// the consumer is gone, which retires the sequence early; on_finish runs
+// exactly once with whether the request completed normally.
+struct GenerationRequest {
+  std::vector<int64_t> prompt;
+  GenerationOptions options;
+  std::function<bool(int64_t)> on_token;
+  std::function<void(bool)> on_finish;
+};
+
+// Continuous batching: new requests are prefilled and merged into the
+// in-flight batch at token boundaries, every active sequence advances through
+// one shared decode_step per iteration, and finished sequences are evicted
+// without stalling the rest. Requires the prefill/decode export interface.
+// The cache layout (padded or paged) comes from cache_options and is shared by
+// every request.
+class ContinuousBatcher {
+ public:
+  ContinuousBatcher(Qwen3Model& model, int64_t max_batch, const GenerationOptions& cache_options);
+
+  // Thread-safe; may be called from connection threads while run() loops.
+  void submit(GenerationRequest request);
+
+  // Scheduling loop; never returns.
+  void run();
+
+ private:
+  struct Sequence {
+    GenerationRequest request;
+    Sampler sampler;
+    std::vector<int64_t> tokens;
+    int64_t generated = 0;
+  };
+
+  std::vector<GenerationRequest> take_pending();
+  void admit(GenerationRequest request);
+  bool emit(Sequence& sequence, const torch::Tensor& row);
+  void step();
+  void fail_all();
+
+  Qwen3Model& model_;
+  const int64_t max_batch_;
+  std::unique_ptr<DecodeCache> cache_;
+  std::vector<Sequence> active_;
+
+  std::mutex mutex_;
+  std::condition_variable pending_cv_;
+  std::deque<GenerationRequest> pending_;
+};
+
+}  // namespace qwen3
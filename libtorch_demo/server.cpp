@@ -0,0 +1,445 @@
+#include "server.h"
+
+#include "scheduler.h"
+
+#include <ATen/Parallel.h>
+
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+namespace qwen3 {
+namespace {
+constexpr int64_t kEndOfStream = -1;
+// Upper bound on accepted prompt length; guards the allocation sized from an
+// untrusted header.
+constexpr uint32_t kMaxPromptTokens = 1u << 20;
+// Upper bound on a request's max-new-tokens override; the KV cache and
+// per-request state grow with it, so a client cannot make a worker allocate
+// without limit. Larger budgets are set with the server's own max_new_tokens.
+constexpr uint32_t kMaxNewTokens = 1u << 13;
+
+// A worker that exits sooner than this after being forked counts as failing
+// on start. Its restarts back off from kFirstRestartDelay, doubling up to
+// kMaxRestartDelay, and the server gives up after kMaxFastRestarts in a row.
+constexpr std::chrono::seconds kMinWorkerUptime{10};
+constexpr std::chrono::milliseconds kFirstRestartDelay{500};
+constexpr std::chrono::milliseconds kMaxRestartDelay{30000};
+constexpr int kMaxFastRestarts = 8;
+
+struct RequestHeader {
+  uint32_t prompt_len;
+  uint32_t max_new_tokens;
+};
+
+// Thrown when the peer goes away mid-request; aborts that request only.
+struct PeerClosed : std::runtime_error {
+  PeerClosed() : std::runtime_error("peer closed the connection") {}
+};
+
+class Socket {
+ public:
+  explicit Socket(int fd) : fd_(fd) {}
+  Socket(const Socket&) = delete;
+  Socket& operator=(const Socket&) = delete;
+  ~Socket() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+  int fd() const { return fd_; }
+  int release() {
+    const int fd = fd_;
+    fd_ = -1;
+    return fd;
+  }
+
+ private:
+  int fd_;
+};
+
+sockaddr_un make_address(const std::string& path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error("Socket path too long: " + path);
+  }
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return address;
+}
+
+void read_exact(int fd, void* buffer, size_t size) {
+  auto* out = static_cast<char*>(buffer);
+  while (size > 0) {
+    const ssize_t n = ::read(fd, out, size);
+    if (n == 0) {
+      throw PeerClosed();
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error(std::string("read failed: ") + std::strerror(errno));
+    }
+    out += n;
+    size -= static_cast<size_t>(n);
+  }
+}
+
+void write_exact(int fd, const void* buffer, size_t size) {
+  const auto* in = static_cast<const char*>(buffer);
+  while (size > 0) {
+    const ssize_t n = ::send(fd, in, size, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EPIPE || errno == ECONNRESET) {
+        throw PeerClosed();
+      }
+      throw std::runtime_error(std::string("send failed: ") + std::strerror(errno));
+    }
+    in += n;
+    size -= static_cast<size_t>(n);
+  }
+}
+
+// Reads one request and applies the server defaults to it.
+GenerationOptions read_request(int fd, const GenerationOptions& defaults, std::vector<int64_t>& prompt) {
+  RequestHeader header{};
+  read_exact(fd, &header, sizeof(header));
+  if (header.prompt_len == 0 || header.prompt_len > kMaxPromptTokens) {
+    throw std::runtime_error("invalid prompt length " + std::to_string(header.prompt_len));
+  }
+  if (header.max_new_tokens > kMaxNewTokens) {
+    throw std::runtime_error("invalid max_new_tokens " + std::to_string(header.max_new_tokens) +
+                             " (limit " + std::to_string(kMaxNewTokens) + ")");
+  }
+  prompt.resize(header.prompt_len);
+  read_exact(fd, prompt.data(), prompt.size() * sizeof(int64_t));
+
+  GenerationOptions options = defaults;
+  if (header.max_new_tokens != 0) {
+    options.max_new_tokens = static_cast<int>(header.max_new_tokens);
+  }
+  return options;
+}
+
+void handle_connection(Qwen3Model& model, int fd, const GenerationOptions& defaults) {
+  std::vector<int64_t> prompt;
+  const GenerationOptions options = read_request(fd, defaults, prompt);
+  generate(model, prompt, options, [fd](int64_t token) {
+    write_exact(fd, &token, sizeof(token));
+  });
+  write_exact(fd, &kEndOfStream, sizeof(kEndOfStream));
+}
+
+// Reads a request on its own thread and hands it to the batcher; the socket
+// stays open until the batcher reports the request finished.
+void submit_connection(ContinuousBatcher& batcher,
+                       std::shared_ptr<Socket> connection,
+                       const GenerationOptions& defaults) {
+  GenerationRequest request;
+  try {
+    request.options = read_request(connection->fd(), defaults, request.prompt);
+  } catch (const PeerClosed&) {
+    std::cerr << "[server] client disconnected before sending a request" << std::endl;
+    return;
+  } catch (const std::exception& ex) {
+    std::cerr << "[server] bad request: " << ex.what() << std::endl;
+    return;
+  }
+
+  request.on_token = [connection](int64_t token) {
+    try {
+      write_exact(connection->fd(), &token, sizeof(token));
+      return true;
+    } catch (const std::exception&) {
+      std::cerr << "[server] client disconnected before the request completed" << std::endl;
+      return false;
+    }
+  };
+  request.on_finish = [connection](bool ok) {
+    if (!ok) {
+      return;
+    }
+    try {
+      write_exact(connection->fd(), &kEndOfStream, sizeof(kEndOfStream));
+    } catch (const std::exception&) {
+      // The client already left; nothing more to deliver.
+    }
+  };
+  batcher.submit(std::move(request));
+}
+
+int listen_on(const std::string& socket_path) {
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    throw std::runtime_error(std::string("socket failed: ") + std::strerror(errno));
+  }
+  Socket listener(fd);
+  const sockaddr_un address = make_address(socket_path);
+  ::unlink(socket_path.c_str());
+  if (::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+    throw std::runtime_error("bind " + socket_path + " failed: " + std::strerror(errno));
+  }
+  if (::listen(fd, 16) != 0) {
+    throw std::runtime_error(std::string("listen failed: ") + std::strerror(errno));
+  }
+  return listener.release();
+}
+
+int accept_connection(int listener) {
+  while (true) {
+    const int fd = ::accept(listener, nullptr, nullptr);
+    if (fd >= 0) {
+      return fd;
+    }
+    if (errno != EINTR) {
+      throw std::runtime_error(std::string("accept failed: ") + std::strerror(errno));
+    }
+  }
+}
+
+void serve_batched(Qwen3Model& model, int listener, const GenerationOptions& defaults, int64_t max_batch) {
+  ContinuousBatcher batcher(model, max_batch, defaults);
+  // Connections are accepted and read off the inference thread so a slow
+  // client never delays the decode loop.
+  std::thread acceptor([&batcher, listener, defaults] {
+    while (true) {
+      std::shared_ptr<Socket> connection;
+      try {
+        connection = std::make_shared<Socket>(accept_connection(listener));
+      } catch (const std::exception& ex) {
+        std::cerr << "[server] " << ex.what() << std::endl;
+        std::exit(3);
+      }
+      std::thread(submit_connection, std::ref(batcher), std::move(connection), defaults).detach();
+    }
+  });
+  acceptor.detach();
+  batcher.run();
+}
+
+void serve_sequential(Qwen3Model& model, int listener, const GenerationOptions& defaults) {
+  while (true) {
+    Socket connection(accept_connection(listener));
+    try {
+      handle_connection(model, connection.fd(), defaults);
+    } catch (const PeerClosed&) {
+      std::cerr << "[server] client disconnected before the request completed" << std::endl;
+    } catch (const c10::Error& error) {
+      std::cerr << "[server] libtorch error: " << error.msg() << std::endl;
+    } catch (const std::exception& ex) {
+      std::cerr << "[server] request failed: " << ex.what() << std::endl;
+    }
+  }
+}
+
+void serve(Qwen3Model& model, int listener, const GenerationOptions& defaults, int64_t max_batch) {
+  if (max_batch > 1) {
+    serve_batched(model, listener, defaults, max_batch);
+  } else {
+    serve_sequential(model, listener, defaults);
+  }
+}
+
+// CPUs this process may run on, in ascending order.
+std::vector<int> allowed_cpus() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  std::vector<int> cpus;
+  if (::sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+  if (cpus.empty()) {
+    cpus.push_back(0);
+  }
+  return cpus;
+}
+
+// Restricts the calling process to cpus[first, first + count), wrapping
+// around when there are more workers than CPUs.
+void pin_worker(const std::vector<int>& cpus, int64_t first, int64_t count) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int64_t i = 0; i < count; ++i) {
+    CPU_SET(cpus[(first + i) % cpus.size()], &set);
+  }
+  if (::sched_setaffinity(0, sizeof(set), &set) != 0) {
+    throw std::runtime_error(std::string("sched_setaffinity failed: ") + std::strerror(errno));
+  }
+}
+}  // namespace
+
+void run_server(Qwen3Model& model,
+                const std::string& socket_path,
+                const GenerationOptions& defaults,
+                const ServerOptions& options) {
+  check_sampling_supported(model.config(), defaults.sampling);
+  check_kv_cache_supported(model.config(), defaults.kv_cache);
+  if (options.max_batch > 1 && !model.config().prefill_decode) {
+    throw std::runtime_error("--max-batch needs a model exported with prefill/decode_step");
+  }
+  if (options.max_batch > 1) {
+    // Rejects an unusable cache layout here rather than in every worker.
+    make_decode_cache(model.config(), defaults);
+  }
+  if (options.workers < 1) {
+    throw std::invalid_argument("worker count must be >= 1");
+  }
+  if (options.workers > 1 && (at::get_num_threads() != 1 || at::in_parallel_region())) {
+    throw std::logic_error(
+        "run_server with several workers needs a model loaded with one intra-op thread "
+        "(at::set_num_threads(1) before Qwen3Model::load)");
+  }
+
+  Socket listener(listen_on(socket_path));
+  std::cout << "Serving on " << socket_path << std::endl;
+
+  if (options.workers == 1) {
+    if (options.threads_per_worker > 0) {
+      at::set_num_threads(static_cast<int>(options.threads_per_worker));
+    }
+    serve(model, listener.fd(), defaults, options.max_batch);
+    return;
+  }
+
+  // Pre-fork: every worker inherits the loaded module, so the weight pages
+  // stay shared copy-on-write (or through the page cache with --mmap) and the
+  // kernel spreads accept() calls on the shared listener across workers. Once
+  // the parent has entered a parallel region, an OpenMP runtime such as
+  // libgomp keeps a thread pool that the children inherit without its
+  // threads and hang on. With one intra-op thread at::parallel_for runs
+  // inline, so a model loaded that way (including its load-time weight
+  // passes, checked before listening) never starts the pool; each child then
+  // sets its own count.
+  const std::vector<int> cpus = allowed_cpus();
+  const int64_t cpus_per_worker = std::max<int64_t>(1, static_cast<int64_t>(cpus.size()) / options.workers);
+  const int64_t threads = options.threads_per_worker > 0 ? options.threads_per_worker : cpus_per_worker;
+
+  auto spawn = [&](int64_t worker) {
+    const pid_t pid = ::fork();
+    if (pid < 0) {
+      throw std::runtime_error(std::string("fork failed: ") + std::strerror(errno));
+    }
+    if (pid > 0) {
+      return pid;
+    }
+    try {
+      pin_worker(cpus, worker * cpus_per_worker, cpus_per_worker);
+      at::set_num_threads(static_cast<int>(threads));
+      std::cout << "[worker " << worker << "] pid " << ::getpid() << ", " << threads
+                << " threads" << std::endl;
+      serve(model, listener.fd(), defaults, options.max_batch);
+    } catch (const std::exception& ex) {
+      std::cerr << "[worker " << worker << "] " << ex.what() << std::endl;
+      std::_Exit(3);
+    }
+    std::_Exit(0);
+  };
+
+  using Clock = std::chrono::steady_clock;
+  struct WorkerSlot {
+    pid_t pid = -1;
+    Clock::time_point started;
+    int fast_restarts = 0;
+  };
+  std::vector<WorkerSlot> workers(static_cast<size_t>(options.workers));
+  for (int64_t worker = 0; worker < options.workers; ++worker) {
+    workers[worker].pid = spawn(worker);
+    workers[worker].started = Clock::now();
+  }
+  while (true) {
+    int status = 0;
+    const pid_t pid = ::waitpid(-1, &status, 0);
+    if (pid < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error(std::string("waitpid failed: ") + std::strerror(errno));
+    }
+    const auto it = std::find_if(workers.begin(), workers.end(),
+                                 [&](const WorkerSlot& slot) { return slot.pid == pid; });
+    if (it == workers.end()) {
+      continue;
+    }
+    const int64_t worker = it - workers.begin();
+    // A worker that dies right after starting will most likely do so again;
+    // back off instead of forking in a tight loop.
+    it->fast_restarts = Clock::now() - it->started < kMinWorkerUptime ? it->fast_restarts + 1 : 0;
+    if (it->fast_restarts > kMaxFastRestarts) {
+      throw std::runtime_error("worker " + std::to_string(worker) + " exited within " +
+                               std::to_string(kMinWorkerUptime.count()) + " s of starting " +
+                               std::to_string(it->fast_restarts) + " times in a row; giving up");
+    }
+    std::chrono::milliseconds delay{0};
+    if (it->fast_restarts > 0) {
+      delay = std::min(kMaxRestartDelay, kFirstRestartDelay * (1 << (it->fast_restarts - 1)));
+    }
+    std::cerr << "[server] worker " << worker << " (pid " << pid << ") exited with status "
+              << status << "; restarting" << (delay.count() > 0 ? " in " + std::to_string(delay.count()) + " ms" : "")
+              << std::endl;
+    std::this_thread::sleep_for(delay);
+    it->pid = spawn(worker);
+    it->started = Clock::now();
+  }
+}
+
+std::vector<int64_t> run_client(const std::string& socket_path,
+                                const std::vector<int64_t>& prompt,
+                                uint32_t max_new_tokens,
+                                const TokenCallback& on_token) {
+  if (max_new_tokens > kMaxNewTokens) {
+    throw std::invalid_argument("max_new_tokens must be <= " + std::to_string(kMaxNewTokens) +
+                                " for --connect");
+  }
+  Socket connection(::socket(AF_UNIX, SOCK_STREAM, 0));
+  if (connection.fd() < 0) {
+    throw std::runtime_error(std::string("socket failed: ") + std::strerror(errno));
+  }
+  const sockaddr_un address = make_address(socket_path);
+  if (::connect(connection.fd(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+    throw std::runtime_error("connect " + socket_path + " failed: " + std::strerror(errno));
+  }
+
+  const RequestHeader header{static_cast<uint32_t>(prompt.size()), max_new_tokens};
+  write_exact(connection.fd(), &header, sizeof(header));
+  write_exact(connection.fd(), prompt.data(), prompt.size() * sizeof(int64_t));
+
+  std::vector<int64_t> generated;
+  while (true) {
+    int64_t token = 0;
+    try {
+      read_exact(connection.fd(), &token, sizeof(token));
+    } catch (const PeerClosed&) {
+      throw std::runtime_error("server closed the connection before finishing the request");
+    }
+    if (token == kEndOfStream) {
+      break;
+    }
+    generated.push_back(token);
+    if (on_token) {
+      on_token(token);
+    }
+  }
+  return generated;
+}
+
+}  // namespace qwen3
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "generation.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace qwen3 {
+
+// Keeps one loaded model resident and serves generation requests over a Unix
+// domain socket. Wire format, native byte order:
+//   request:  uint32 prompt_len, uint32 max_new_tokens (0 = server default),
+//             then prompt_len int64 token ids
+//   response: one int64 per generated token as soon as it is produced,
+//             then int64 -1 as terminator
+// A connection closed without the terminator means the request failed.
+struct ServerOptions {
+  // Decode up to this many requests together through a ContinuousBatcher,
+  // admitting new ones between steps.
+  int64_t max_batch = 1;
+  // Worker processes forked after the model is loaded; they share its weights
+  // and one listening socket, each pinned to its own slice of the CPUs.
+  int64_t workers = 1;
+  // Intra-op threads per worker; 0 uses the size of the worker's CPU slice.
+  int64_t threads_per_worker = 0;
+};
+
+// With more than one worker, model must have been loaded (load-time weight
+// passes included) with at::set_num_threads(1) and no parallel op run since:
+// forking after an OpenMP parallel region leaves the children with a dead
+// thread pool. Each worker sets its own thread count after the fork. Workers
+// that crash are restarted, with a growing delay for ones that crash on start.
+void run_server(Qwen3Model& model,
+                const std::string& socket_path,
+                const GenerationOptions& defaults,
+                const ServerOptions& options = {});
+
+// Sends one request to a running server and returns the generated tokens
+// (without the prompt), invoking on_token as each one arrives.
+std::vector<int64_t> run_client(const std::string& socket_path,
+                                const std::vector<int64_t>& prompt,
+                                uint32_t max_new_tokens,
+                                const TokenCallback& on_token = nullptr);
+
+}  // namespace qwen3
@@ -0,0 +1,127 @@
+#include "vector_kernels.h"
+
+#if defined(__riscv) && defined(__linux__)
+#include <sys/auxv.h>
+#endif
+
+#include <atomic>
+#include <fstream>
+#include <stdexcept>
+
+namespace qwen3 {
+namespace kernels {
+namespace {
+#if defined(__riscv) && defined(__linux__)
+// Linux sets bit ('V' - 'A') of AT_HWCAP once it can context-switch vector
+// state; before that (or with V disabled) vector instructions trap.
+constexpr unsigned long kHwcapV = 1ul << ('V' - 'A');
+#endif
+
+std::string cpuinfo_isa() {
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpuinfo, line)) {
+    if (line.compare(0, 3, "isa") != 0) {
+      continue;
+    }
+    const size_t colon = line.find(':');
+    if (colon == std::string::npos) {
+      continue;
+    }
+    const size_t start = line.find_first_not_of(" \t", colon + 1);
+    return start == std::string::npos ? std::string() : line.substr(start);
+  }
+  return std::string();
+}
+
+bool can_run(const KernelTable& table, const VectorSupport& support) {
+  return table.vlen == 0 || support.rvv;
+}
+
+std::atomic<const KernelTable*> g_active{nullptr};
+}  // namespace
+
+VectorSupport detect_vector_support() {
+  VectorSupport support;
+  support.isa = cpuinfo_isa();
+#if defined(__riscv) && defined(__linux__)
+  support.rvv = (getauxval(AT_HWCAP) & kHwcapV) != 0;
+#endif
+#if defined(QWEN3_HAVE_RVV)
+  if (support.rvv) {
+    support.vlen = rvv::vector_length_bits();
+  }
+#endif
+  return support;
+}
+
+const std::vector<const KernelTable*>& kernel_tables() {
+  static const std::vector<const KernelTable*> tables = {
+      &scalar::kTable,
+#if defined(QWEN3_HAVE_RVV)
+      &rvv::kVlen128Table,
+      &rvv::kVlen256Table,
+      &rvv::kVlen512Table,
+#endif
+  };
+  return tables;
+}
+
+std::vector<const KernelTable*> usable_kernel_tables() {
+  const VectorSupport support = detect_vector_support();
+  std::vector<const KernelTable*> usable;
+  for (const KernelTable* table : kernel_tables()) {
+    if (can_run(*table, support)) {
+      usable.push_back(table);
+    }
+  }
+  return usable;
+}
+
+const KernelTable& select_kernels(const std::string& name) {
+  const VectorSupport support = detect_vector_support();
+  const KernelTable* chosen = nullptr;
+  if (name.empty()) {
+    chosen = &scalar::kTable;
+    for (const KernelTable* table : kernel_tables()) {
+      if (can_run(*table, support) && table->vlen > chosen->vlen && table->vlen <= support.vlen) {
+        chosen = table;
+      }
+    }
+    // VLEN below every table's tuning point (e.g. 64): the narrowest still
+    // runs correctly and beats scalar code.
+    if (chosen->vlen == 0 && support.rvv) {
+      for (const KernelTable* table : kernel_tables()) {
+        if (table->vlen != 0) {
+          chosen = table;
+          break;
+        }
+      }
+    }
+  } else {
+    std::string names;
+    for (const KernelTable* table : kernel_tables()) {
+      names += (names.empty() ? "" : ", ") + std::string(table->name);
+      if (name == table->name) {
+        chosen = table;
+      }
+    }
+    if (chosen == nullptr) {
+      throw std::invalid_argument("Unknown kernel table '" + name + "' (this build has: " + names + ")");
+    }
+    if (!can_run(*chosen, support)) {
+      throw std::invalid_argument("Kernel table '" + name +
+                                  "' needs the RISC-V V extension, which this CPU does not report");
+    }
+  }
+  g_active.store(chosen);
+  return *chosen;
+}
+
+const KernelTable& active() {
+  const KernelTable* table = g_active.load();
+  return table != nullptr ? *table : select_kernels("");
+}
+
+}  // namespace kernels
+}  // namespace qwen3
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// fp32 kernels for the decode hot path, on raw pointers and independent of
+// libtorch. Every kernel has a portable scalar implementation; builds with
+// QWEN3_HAVE_RVV add vector-length-agnostic RVV 1.0 versions, compiled for
+// rv64gcv in their own translation unit and only called once the running CPU
+// is known to have the V extension.
+//
+//   dot       sum of a[i] * b[i]
+//   gemv      y[r] = dot(w + r * cols, x) for a row-major [rows, cols] w
+//   rms_norm  out = x / sqrt(mean(x^2) + eps) * weight
+//   silu_mul  out = silu(gate) * up, silu(g) = g / (1 + exp(-g))
+//   softmax   in place over n values
+//   rope      one head of rotate-half RoPE: out = x * cos + rotate_half(x) * sin
+
+namespace qwen3 {
+namespace kernels {
+
+// One implementation of every kernel. Callers go through active() so a
+// single binary picks its code path at startup.
+struct KernelTable {
+  const char* name;
+  // Smallest VLEN in bits the table is tuned for; 0 for scalar code.
+  int64_t vlen;
+  float (*dot)(const float* a, const float* b, int64_t n);
+  void (*gemv)(const float* w, const float* x, float* y, int64_t rows, int64_t cols);
+  void (*rms_norm)(const float* x, const float* weight, float* out, int64_t n, float eps);
+  void (*silu_mul)(const float* gate, const float* up, float* out, int64_t n);
+  void (*softmax)(float* x, int64_t n);
+  void (*rope)(const float* x, const float* cos, const float* sin, float* out, int64_t head_dim);
+};
+
+// What the running CPU and kernel report about the vector extension.
+struct VectorSupport {
+  // AT_HWCAP has the V bit: the kernel saves vector state, so V code may run.
+  bool rvv = false;
+  // VLEN in bits (vlenb * 8), or 0 without V.
+  int64_t vlen = 0;
+  // First "isa" line of /proc/cpuinfo, for the log; empty if unavailable.
+  std::string isa;
+};
+
+VectorSupport detect_vector_support();
+
+// Every table this binary contains, scalar first, whether or not the CPU can
+// run it.
+const std::vector<const KernelTable*>& kernel_tables();
+
+// Tables from kernel_tables() that can run on this CPU.
+std::vector<const KernelTable*> usable_kernel_tables();
+
+// Makes a table the active one and returns it. An empty name picks the best
+// usable table: the RVV table with the largest vlen not above the CPU's VLEN,
+// else scalar. Throws std::invalid_argument for an unknown name or a table
+// this CPU cannot run.
+const KernelTable& select_kernels(const std::string& name);
+
+// The selected table; the first call without select_kernels picks
+// automatically.
+const KernelTable& active();
+
+namespace scalar {
+extern const KernelTable kTable;
+}  // namespace scalar
+
+#if defined(QWEN3_HAVE_RVV)
+namespace rvv {
+// Same kernels, with the register grouping (LMUL) chosen so one strip is 32
+// floats at the table's VLEN: m8 at 128 bits, m4 at 256, m2 at 512 and up.
+// Smaller groups leave room for four-row GEMV blocking on wider machines.
+extern const KernelTable kVlen128Table;
+extern const KernelTable kVlen256Table;
+extern const KernelTable kVlen512Table;
+
+// vlenb * 8, read with vsetvlmax; only call on a CPU with V.
+int64_t vector_length_bits();
+}  // namespace rvv
+#endif
+
+}  // namespace kernels
+}  // namespace qwen3
@@ -0,0 +1,218 @@
+// RVV 1.0 versions of the kernels in vector_kernels.h. This file is built
+// with -march=rv64gcv and must only run on harts with the V extension. Every
+// loop is strip-mined with vsetvl, so each table runs at any VLEN; the tables
+// differ in LMUL, which is what the VLEN they are named after tunes.
+
+#include "vector_kernels.h"
+
+#include <riscv_vector.h>
+
+#include <limits>
+
+namespace qwen3 {
+namespace kernels {
+namespace rvv {
+namespace {
+constexpr float kLog2e = 1.44269504088896341f;
+// ln(2) split so that k * kLn2Hi is exact for the k range exp() sees.
+constexpr float kLn2Hi = 0.693359375f;
+constexpr float kLn2Lo = -2.12194440e-4f;
+// Clamp range for exp(); both ends keep the 2^k exponent field normal.
+constexpr float kExpMax = 88.0f;
+constexpr float kExpMin = -87.3365447504019f;
+
+// The fp32 operations the LMUL-generic kernels need, for one register
+// grouping. kRowBlock is how many GEMV rows share each load of x: four
+// accumulators plus x and w take six groups, which only fits below m8.
+#define QWEN3_RVV_F32_OPS(Name, lmul, row_block)                                          \
+  struct Name {                                                                           \
+    using V = vfloat32##lmul##_t;                                                         \
+    static constexpr int kRowBlock = row_block;                                           \
+    static size_t setvl(size_t n) { return __riscv_vsetvl_e32##lmul(n); }                 \
+    static size_t vlmax() { return __riscv_vsetvlmax_e32##lmul(); }                       \
+    static V load(const float* p, size_t vl) { return __riscv_vle32_v_f32##lmul(p, vl); } \
+    static void store(float* p, V v, size_t vl) { __riscv_vse32_v_f32##lmul(p, v, vl); }  \
+    static V zero(size_t vl) { return __riscv_vfmv_v_f_f32##lmul(0.0f, vl); }             \
+    /* Tail-undisturbed, so lanes past a short final strip keep their sums. */            \
+    static V fmacc(V acc, V a, V b, size_t vl) {                                          \
+      return __riscv_vfmacc_vv_f32##lmul##_tu(acc, a, b, vl);                             \
+    }                                                                                     \
+    static V mul(V a, V b, size_t vl) { return __riscv_vfmul_vv_f32##lmul(a, b, vl); }    \
+    static V mul(V a, float b, size_t vl) { return __riscv_vfmul_vf_f32##lmul(a, b, vl); } \
+    static float sum(V v, size_t vl) {                                                    \
+      const vfloat32m1_t zero = __riscv_vfmv_s_f_f32m1(0.0f, 1);                          \
+      return __riscv_vfmv_f_s_f32m1_f32(__riscv_vfredusum_vs_f32##lmul##_f32m1(v, zero, vl)); \
+    }                                                                                     \
+    static vfloat32m1_t max(V v, vfloat32m1_t running, size_t vl) {                       \
+      return __riscv_vfredmax_vs_f32##lmul##_f32m1(v, running, vl);                       \
+    }                                                                                     \
+  };
+
+QWEN3_RVV_F32_OPS(M8, m8, 1)
+QWEN3_RVV_F32_OPS(M4, m4, 4)
+QWEN3_RVV_F32_OPS(M2, m2, 4)
+#undef QWEN3_RVV_F32_OPS
+
+// exp(x) as 2^k * p(r) with x = k * ln2 + r and |r| <= ln2 / 2, where p is
+// the degree-6 Taylor polynomial (relative error below 2e-7 in that range).
+vfloat32m4_t exp_f32m4(vfloat32m4_t x, size_t vl) {
+  x = __riscv_vfmin_vf_f32m4(__riscv_vfmax_vf_f32m4(x, kExpMin, vl), kExpMax, vl);
+  const vint32m4_t k = __riscv_vfcvt_x_f_v_i32m4(__riscv_vfmul_vf_f32m4(x, kLog2e, vl), vl);
+  const vfloat32m4_t kf = __riscv_vfcvt_f_x_v_f32m4(k, vl);
+  vfloat32m4_t r = __riscv_vfnmsac_vf_f32m4(x, kLn2Hi, kf, vl);
+  r = __riscv_vfnmsac_vf_f32m4(r, kLn2Lo, kf, vl);
+
+  vfloat32m4_t p = __riscv_vfmv_v_f_f32m4(1.0f / 720.0f, vl);
+  p = __riscv_vfadd_vf_f32m4(__riscv_vfmul_vv_f32m4(p, r, vl), 1.0f / 120.0f, vl);
+  p = __riscv_vfadd_vf_f32m4(__riscv_vfmul_vv_f32m4(p, r, vl), 1.0f / 24.0f, vl);
+  p = __riscv_vfadd_vf_f32m4(__riscv_vfmul_vv_f32m4(p, r, vl), 1.0f / 6.0f, vl);
+  p = __riscv_vfadd_vf_f32m4(__riscv_vfmul_vv_f32m4(p, r, vl), 0.5f, vl);
+  p = __riscv_vfadd_vf_f32m4(__riscv_vfmul_vv_f32m4(p, r, vl), 1.0f, vl);
+  p = __riscv_vfadd_vf_f32m4(__riscv_vfmul_vv_f32m4(p, r, vl), 1.0f, vl);
+
+  // 2^k built directly in the exponent field; k stays within [-126, 127].
+  const vint32m4_t bits = __riscv_vsll_vx_i32m4(__riscv_vadd_vx_i32m4(k, 127, vl), 23, vl);
+  return __riscv_vfmul_vv_f32m4(p, __riscv_vreinterpret_v_i32m4_f32m4(bits), vl);
+}
+
+template <typename Ops>
+float dot(const float* a, const float* b, int64_t n) {
+  const size_t vlmax = Ops::vlmax();
+  typename Ops::V acc = Ops::zero(vlmax);
+  for (size_t i = 0, remaining = static_cast<size_t>(n); remaining > 0;) {
+    const size_t vl = Ops::setvl(remaining);
+    acc = Ops::fmacc(acc, Ops::load(a + i, vl), Ops::load(b + i, vl), vl);
+    i += vl;
+    remaining -= vl;
+  }
+  return Ops::sum(acc, vlmax);
+}
+
+template <typename Ops>
+void gemv(const float* w, const float* x, float* y, int64_t rows, int64_t cols) {
+  int64_t r = 0;
+  if constexpr (Ops::kRowBlock == 4) {
+    const size_t vlmax = Ops::vlmax();
+    for (; r + 4 <= rows; r += 4) {
+      const float* w0 = w + r * cols;
+      const float* w1 = w0 + cols;
+      const float* w2 = w1 + cols;
+      const float* w3 = w2 + cols;
+      typename Ops::V acc0 = Ops::zero(vlmax);
+      typename Ops::V acc1 = Ops::zero(vlmax);
+      typename Ops::V acc2 = Ops::zero(vlmax);
+      typename Ops::V acc3 = Ops::zero(vlmax);
+      for (size_t i = 0, remaining = static_cast<size_t>(cols); remaining > 0;) {
+        const size_t vl = Ops::setvl(remaining);
+        const typename Ops::V vx = Ops::load(x + i, vl);
+        acc0 = Ops::fmacc(acc0, Ops::load(w0 + i, vl), vx, vl);
+        acc1 = Ops::fmacc(acc1, Ops::load(w1 + i, vl), vx, vl);
+        acc2 = Ops::fmacc(acc2, Ops::load(w2 + i, vl), vx, vl);
+        acc3 = Ops::fmacc(acc3, Ops::load(w3 + i, vl), vx, vl);
+        i += vl;
+        remaining -= vl;
+      }
+      y[r] = Ops::sum(acc0, vlmax);
+      y[r + 1] = Ops::sum(acc1, vlmax);
+      y[r + 2] = Ops::sum(acc2, vlmax);
+      y[r + 3] = Ops::sum(acc3, vlmax);
+    }
+  }
+  for (; r < rows; ++r) {
+    y[r] = dot<Ops>(w + r * cols, x, cols);
+  }
+}
+
+template <typename Ops>
+void rms_norm(const float* x, const float* weight, float* out, int64_t n, float eps) {
+  const float mean_square = dot<Ops>(x, x, n) / static_cast<float>(n);
+  const float scale = 1.0f / __builtin_sqrtf(mean_square + eps);
+  for (size_t i = 0, remaining = static_cast<size_t>(n); remaining > 0;) {
+    const size_t vl = Ops::setvl(remaining);
+    const typename Ops::V vx = Ops::mul(Ops::load(x + i, vl), scale, vl);
+    Ops::store(out + i, Ops::mul(vx, Ops::load(weight + i, vl), vl), vl);
+    i += vl;
+    remaining -= vl;
+  }
+}
+
+// silu_mul, the exp pass of softmax and rope keep m4 in every table: exp
+// holds several temporaries live, and m4 already covers half of a 128-wide
+// head per strip at VLEN 256.
+void silu_mul(const float* gate, const float* up, float* out, int64_t n) {
+  for (size_t i = 0, remaining = static_cast<size_t>(n); remaining > 0;) {
+    const size_t vl = __riscv_vsetvl_e32m4(remaining);
+    const vfloat32m4_t g = __riscv_vle32_v_f32m4(gate + i, vl);
+    const vfloat32m4_t e = exp_f32m4(__riscv_vfneg_v_f32m4(g, vl), vl);
+    const vfloat32m4_t silu = __riscv_vfdiv_vv_f32m4(g, __riscv_vfadd_vf_f32m4(e, 1.0f, vl), vl);
+    __riscv_vse32_v_f32m4(out + i, __riscv_vfmul_vv_f32m4(silu, __riscv_vle32_v_f32m4(up + i, vl), vl), vl);
+    i += vl;
+    remaining -= vl;
+  }
+}
+
+template <typename Ops>
+void softmax(float* x, int64_t n) {
+  vfloat32m1_t max_value = __riscv_vfmv_s_f_f32m1(-std::numeric_limits<float>::infinity(), 1);
+  for (size_t i = 0, remaining = static_cast<size_t>(n); remaining > 0;) {
+    const size_t vl = Ops::setvl(remaining);
+    max_value = Ops::max(Ops::load(x + i, vl), max_value, vl);
+    i += vl;
+    remaining -= vl;
+  }
+  const float shift = __riscv_vfmv_f_s_f32m1_f32(max_value);
+
+  vfloat32m1_t sum = __riscv_vfmv_s_f_f32m1(0.0f, 1);
+  for (size_t i = 0, remaining = static_cast<size_t>(n); remaining > 0;) {
+    const size_t vl = __riscv_vsetvl_e32m4(remaining);
+    const vfloat32m4_t e = exp_f32m4(__riscv_vfsub_vf_f32m4(__riscv_vle32_v_f32m4(x + i, vl), shift, vl), vl);
+    __riscv_vse32_v_f32m4(x + i, e, vl);
+    sum = __riscv_vfredusum_vs_f32m4_f32m1(e, sum, vl);
+    i += vl;
+    remaining -= vl;
+  }
+
+  const float inv_sum = 1.0f / __riscv_vfmv_f_s_f32m1_f32(sum);
+  for (size_t i = 0, remaining = static_cast<size_t>(n); remaining > 0;) {
+    const size_t vl = Ops::setvl(remaining);
+    Ops::store(x + i, Ops::mul(Ops::load(x + i, vl), inv_sum, vl), vl);
+    i += vl;
+    remaining -= vl;
+  }
+}
+
+void rope(const float* x, const float* cos, const float* sin, float* out, int64_t head_dim) {
+  const size_t half = static_cast<size_t>(head_dim / 2);
+  for (size_t i = 0, remaining = half; remaining > 0;) {
+    const size_t vl = __riscv_vsetvl_e32m4(remaining);
+    const vfloat32m4_t x1 = __riscv_vle32_v_f32m4(x + i, vl);
+    const vfloat32m4_t x2 = __riscv_vle32_v_f32m4(x + half + i, vl);
+    // out1 = x1 * cos1 - x2 * sin1, out2 = x2 * cos2 + x1 * sin2
+    vfloat32m4_t out1 = __riscv_vfmul_vv_f32m4(x1, __riscv_vle32_v_f32m4(cos + i, vl), vl);
+    out1 = __riscv_vfnmsac_vv_f32m4(out1, x2, __riscv_vle32_v_f32m4(sin + i, vl), vl);
+    vfloat32m4_t out2 = __riscv_vfmul_vv_f32m4(x2, __riscv_vle32_v_f32m4(cos + half + i, vl), vl);
+    out2 = __riscv_vfmacc_vv_f32m4(out2, x1, __riscv_vle32_v_f32m4(sin + half + i, vl), vl);
+    __riscv_vse32_v_f32m4(out + i, out1, vl);
+    __riscv_vse32_v_f32m4(out + half + i, out2, vl);
+    i += vl;
+    remaining -= vl;
+  }
+}
+
+template <typename Ops>
+constexpr KernelTable make_table(const char* name, int64_t vlen) {
+  return {name, vlen, dot<Ops>, gemv<Ops>, rms_norm<Ops>, silu_mul, softmax<Ops>, rope};
+}
+}  // namespace
+
+const KernelTable kVlen128Table = make_table<M8>("rvv128", 128);
+const KernelTable kVlen256Table = make_table<M4>("rvv256", 256);
+const KernelTable kVlen512Table = make_table<M2>("rvv512", 512);
+
+int64_t vector_length_bits() {
+  return static_cast<int64_t>(__riscv_vsetvlmax_e8m1()) * 8;
+}
+
+}  // namespace rvv
+}  // namespace kernels
+}  // namespace qwen3
@@ -0,0 +1,71 @@
+#include "vector_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace qwen3 {
+namespace kernels {
+namespace scalar {
+namespace {
+
+float dot(const float* a, const float* b, int64_t n) {
+  float acc = 0.0f;
+  for (int64_t i = 0; i < n; ++i) {
+    acc += a[i] * b[i];
+  }
+  return acc;
+}
+
+void gemv(const float* w, const float* x, float* y, int64_t rows, int64_t cols) {
+  for (int64_t r = 0; r < rows; ++r) {
+    y[r] = dot(w + r * cols, x, cols);
+  }
+}
+
+void rms_norm(const float* x, const float* weight, float* out, int64_t n, float eps) {
+  const float scale = 1.0f / std::sqrt(dot(x, x, n) / static_cast<float>(n) + eps);
+  for (int64_t i = 0; i < n; ++i) {
+    out[i] = x[i] * scale * weight[i];
+  }
+}
+
+void silu_mul(const float* gate, const float* up, float* out, int64_t n) {
+  for (int64_t i = 0; i < n; ++i) {
+    out[i] = gate[i] / (1.0f + std::exp(-gate[i])) * up[i];
+  }
+}
+
+void softmax(float* x, int64_t n) {
+  float max_value = -std::numeric_limits<float>::infinity();
+  for (int64_t i = 0; i < n; ++i) {
+    max_value = std::max(max_value, x[i]);
+  }
+  float sum = 0.0f;
+  for (int64_t i = 0; i < n; ++i) {
+    x[i] = std::exp(x[i] - max_value);
+    sum += x[i];
+  }
+  const float inv_sum = 1.0f / sum;
+  for (int64_t i = 0; i < n; ++i) {
+    x[i] *= inv_sum;
+  }
+}
+
+void rope(const float* x, const float* cos, const float* sin, float* out, int64_t head_dim) {
+  const int64_t half = head_dim / 2;
+  for (int64_t i = 0; i < half; ++i) {
+    const float x1 = x[i];
+    const float x2 = x[half + i];
+    out[i] = x1 * cos[i] - x2 * sin[i];
+    out[half + i] = x2 * cos[half + i] + x1 * sin[half + i];
+  }
+}
+
+}  // namespace
+
+const KernelTable kTable = {"scalar", 0, dot, gemv, rms_norm, silu_mul, softmax, rope};
+
+}  // namespace scalar
+}  // namespace kernels
+}  // namespace qwen3
@@ -0,0 +1,232 @@
+#include "vector_ops.h"
+
+#include "linear_common.h"
+#include "vector_kernels.h"
+
+#include <ATen/Parallel.h>
+#include <torch/library.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <string>
+
+namespace qwen3 {
+namespace {
+// Output channels per task; 64 fp32 rows of a 1024-wide matrix are 256 KB.
+constexpr int64_t kRowTile = 64;
+// Rows of normalization, activation or softmax work per task.
+constexpr int64_t kRowGrain = 16;
+// Elements of silu_mul per task.
+constexpr int64_t kElementGrain = 4096;
+
+// check_vector_ops tolerance; the kernels only reorder fp32 sums and use a
+// polynomial exp, so anything larger is a bug rather than rounding.
+constexpr double kCheckTolerance = 1e-4;
+
+// Prints one result line and returns whether actual matches expected.
+bool report(std::ostream& out, const std::string& name, const at::Tensor& actual, const at::Tensor& expected) {
+  const double error = (actual - expected).abs().max().item<double>();
+  const double scale = 1.0 + expected.abs().max().item<double>();
+  const bool ok = actual.sizes() == expected.sizes() && error <= kCheckTolerance * scale;
+  out << (ok ? "  ok    " : "  FAIL  ") << std::left << std::setw(32) << name
+      << " max abs error " << std::scientific << std::setprecision(2) << error << std::defaultfloat
+      << std::endl;
+  return ok;
+}
+}  // namespace
+
+at::Tensor vec_linear(const at::Tensor& input,
+                      const at::Tensor& weight,
+                      const c10::optional<at::Tensor>& bias) {
+  const kernels::KernelTable& table = kernels::active();
+  TORCH_CHECK(weight.dim() == 2 && weight.scalar_type() == at::kFloat,
+              "vec_linear: weight must be a 2-D float32 tensor");
+  const int64_t out_features = weight.size(0);
+  const int64_t width = weight.size(1);
+  TORCH_CHECK(input.size(-1) == width, "vec_linear: input size ", input.size(-1),
+              " does not match weight width ", width);
+
+  const at::Tensor rows = flatten_input(input, width);
+  const int64_t m = rows.size(0);
+  const at::Tensor w = weight.contiguous();
+  at::Tensor out = at::empty({m, out_features}, rows.options());
+
+  const float* x = rows.data_ptr<float>();
+  const float* wp = w.data_ptr<float>();
+  float* y = out.data_ptr<float>();
+  const int64_t tiles = (out_features + kRowTile - 1) / kRowTile;
+  at::parallel_for(0, tiles, 1, [&](int64_t begin, int64_t end) {
+    for (int64_t tile = begin; tile < end; ++tile) {
+      const int64_t first = tile * kRowTile;
+      const int64_t count = std::min(out_features, first + kRowTile) - first;
+      for (int64_t i = 0; i < m; ++i) {
+        table.gemv(wp + first * width, x + i * width, y + i * out_features + first, count, width);
+      }
+    }
+  });
+  if (bias.has_value() && bias->defined()) {
+    out.add_(bias->to(at::kFloat));
+  }
+
+  return finish_linear(out, input, out_features);
+}
+
+at::Tensor rms_norm(const at::Tensor& input, const at::Tensor& weight, double eps) {
+  const kernels::KernelTable& table = kernels::active();
+  const int64_t width = input.size(-1);
+  TORCH_CHECK(weight.numel() == width, "rms_norm: expected ", width, " weights, got ", weight.numel());
+  const at::Tensor rows = flatten_input(input, width);
+  const at::Tensor w = weight.to(at::kFloat).contiguous();
+  at::Tensor out = at::empty_like(rows);
+
+  const float* x = rows.data_ptr<float>();
+  const float* wp = w.data_ptr<float>();
+  float* y = out.data_ptr<float>();
+  at::parallel_for(0, rows.size(0), kRowGrain, [&](int64_t begin, int64_t end) {
+    for (int64_t r = begin; r < end; ++r) {
+      table.rms_norm(x + r * width, wp, y + r * width, width, static_cast<float>(eps));
+    }
+  });
+  return out.to(input.scalar_type()).reshape(input.sizes());
+}
+
+at::Tensor silu_mul(const at::Tensor& gate, const at::Tensor& up) {
+  const kernels::KernelTable& table = kernels::active();
+  TORCH_CHECK(gate.sizes() == up.sizes(), "silu_mul: gate ", gate.sizes(), " and up ", up.sizes(),
+              " must have the same shape");
+  const at::Tensor g = gate.to(at::kFloat).contiguous();
+  const at::Tensor u = up.to(at::kFloat).contiguous();
+  at::Tensor out = at::empty_like(g);
+
+  const float* gp = g.data_ptr<float>();
+  const float* upp = u.data_ptr<float>();
+  float* y = out.data_ptr<float>();
+  at::parallel_for(0, g.numel(), kElementGrain, [&](int64_t begin, int64_t end) {
+    table.silu_mul(gp + begin, upp + begin, y + begin, end - begin);
+  });
+  return out.to(gate.scalar_type());
+}
+
+at::Tensor softmax_lastdim(const at::Tensor& input) {
+  const kernels::KernelTable& table = kernels::active();
+  const int64_t width = input.size(-1);
+  at::Tensor out = input.reshape({-1, width}).to(at::kFloat).clone(at::MemoryFormat::Contiguous);
+
+  float* y = out.data_ptr<float>();
+  at::parallel_for(0, out.size(0), kRowGrain, [&](int64_t begin, int64_t end) {
+    for (int64_t r = begin; r < end; ++r) {
+      table.softmax(y + r * width, width);
+    }
+  });
+  return out.to(input.scalar_type()).reshape(input.sizes());
+}
+
+at::Tensor rope(const at::Tensor& input, const at::Tensor& cos, const at::Tensor& sin) {
+  const kernels::KernelTable& table = kernels::active();
+  TORCH_CHECK(input.dim() == 4, "rope: input must be [batch, heads, seq, head_dim]");
+  const int64_t batch = input.size(0);
+  const int64_t heads = input.size(1);
+  const int64_t seq = input.size(2);
+  const int64_t head_dim = input.size(3);
+  TORCH_CHECK(head_dim % 2 == 0, "rope: head_dim ", head_dim, " must be even");
+  TORCH_CHECK(cos.dim() == 3 && cos.sizes() == sin.sizes() && cos.size(1) == seq &&
+                  cos.size(2) == head_dim && (cos.size(0) == batch || cos.size(0) == 1),
+              "rope: cos and sin must be [batch or 1, seq, head_dim]");
+
+  const at::Tensor x = input.to(at::kFloat).contiguous();
+  const at::Tensor c = cos.to(at::kFloat).contiguous();
+  const at::Tensor s = sin.to(at::kFloat).contiguous();
+  at::Tensor out = at::empty_like(x);
+
+  const float* xp = x.data_ptr<float>();
+  const float* cp = c.data_ptr<float>();
+  const float* sp = s.data_ptr<float>();
+  float* y = out.data_ptr<float>();
+  const int64_t cos_batch_stride = c.size(0) == 1 ? 0 : seq * head_dim;
+  at::parallel_for(0, batch * heads * seq, kRowGrain, [&](int64_t begin, int64_t end) {
+    for (int64_t row = begin; row < end; ++row) {
+      const int64_t b = row / (heads * seq);
+      const int64_t t = row % seq;
+      const int64_t offset = b * cos_batch_stride + t * head_dim;
+      table.rope(xp + row * head_dim, cp + offset, sp + offset, y + row * head_dim, head_dim);
+    }
+  });
+  return out.to(input.scalar_type());
+}
+
+namespace {
+// Every case of check_vector_ops against the active table.
+bool check_active_kernels(std::ostream& out) {
+  at::manual_seed(0);
+  bool ok = true;
+
+  // Widths cover a single element, odd tails and the Qwen3 hidden sizes.
+  for (const int64_t width : {1, 7, 67, 128, 1024, 1031}) {
+    const std::string suffix = "[" + std::to_string(width) + "]";
+    const at::Tensor a = at::randn({3, width});
+    const at::Tensor b = at::randn({3, width});
+    const at::Tensor weight = at::randn({129, width});
+    const at::Tensor bias = at::randn({129});
+    ok &= report(out, "vec_linear" + suffix, vec_linear(a, weight, bias), at::linear(a, weight, bias));
+
+    const at::Tensor norm_weight = at::randn({width});
+    const at::Tensor expected_norm = a * at::rsqrt(a.pow(2).mean(-1, true) + 1e-6) * norm_weight;
+    ok &= report(out, "rms_norm" + suffix, rms_norm(a, norm_weight, 1e-6), expected_norm);
+
+    // Gates far outside [-1, 1] exercise the clamped ends of exp.
+    const at::Tensor gate = a * 40.0;
+    ok &= report(out, "silu_mul" + suffix, silu_mul(gate, b), at::silu(gate) * b);
+
+    at::Tensor scores = a * 10.0;
+    scores.select(0, 1).narrow(0, 0, (width + 1) / 2).fill_(std::numeric_limits<float>::lowest());
+    ok &= report(out, "softmax_lastdim" + suffix, softmax_lastdim(scores), at::softmax(scores, -1));
+  }
+
+  for (const int64_t head_dim : {2, 64, 128}) {
+    const at::Tensor x = at::randn({2, 3, 5, head_dim});
+    const at::Tensor angles = at::randn({2, 5, head_dim / 2}).repeat({1, 1, 2});
+    const at::Tensor cos = angles.cos();
+    const at::Tensor sin = angles.sin();
+    const at::Tensor rotated = at::cat({-x.narrow(-1, head_dim / 2, head_dim / 2), x.narrow(-1, 0, head_dim / 2)}, -1);
+    const at::Tensor expected = x * cos.unsqueeze(1) + rotated * sin.unsqueeze(1);
+    ok &= report(out, "rope[" + std::to_string(head_dim) + "]", rope(x, cos, sin), expected);
+  }
+
+  return ok;
+}
+}  // namespace
+
+bool check_vector_ops(std::ostream& out) {
+  const kernels::VectorSupport support = kernels::detect_vector_support();
+  out << "CPU isa: " << (support.isa.empty() ? "unknown" : support.isa) << ", V "
+      << (support.rvv ? "VLEN " + std::to_string(support.vlen) : std::string("unavailable")) << std::endl;
+  const std::string previous = kernels::active().name;
+  bool ok = true;
+  for (const kernels::KernelTable* table : kernels::usable_kernel_tables()) {
+    kernels::select_kernels(table->name);
+    out << "Checking " << table->name << " kernels against ATen" << std::endl;
+    ok &= check_active_kernels(out);
+  }
+  kernels::select_kernels(previous);
+  out << (ok ? "All kernels match." : "Kernel check FAILED.") << std::endl;
+  return ok;
+}
+
+}  // namespace qwen3
+
+TORCH_LIBRARY_FRAGMENT(qwen, m) {
+  m.def("vec_linear(Tensor input, Tensor weight, Tensor? bias) -> Tensor");
+  m.def("rms_norm(Tensor input, Tensor weight, float eps) -> Tensor");
+  m.def("silu_mul(Tensor gate, Tensor up) -> Tensor");
+  m.def("softmax_lastdim(Tensor input) -> Tensor");
+  m.def("rope(Tensor input, Tensor cos, Tensor sin) -> Tensor");
+}
+
+TORCH_LIBRARY_IMPL(qwen, CPU, m) {
+  m.impl("vec_linear", &qwen3::vec_linear);
+  m.impl("rms_norm", &qwen3::rms_norm);
+  m.impl("silu_mul", &qwen3::silu_mul);
+  m.impl("softmax_lastdim", &qwen3::softmax_lastdim);
+  m.impl("rope", &qwen3::rope);
+}
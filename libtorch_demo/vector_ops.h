@@ -0,0 +1,51 @@
+#pragma once
+
+#include <ATen/ATen.h>
+
+#include <c10/util/Optional.h>
+
+#include <ostream>
+
+namespace qwen3 {
+
+// TorchScript ops over the fp32 kernels in vector_kernels.h. Every call
+// looks up kernels::active(), the KernelTable chosen at startup for the
+// running CPU (scalar, or an RVV table for its VLEN) or forced with
+// qwen3_infer --kernels, so one binary runs on CPUs with and without V. All
+// of them compute in fp32 and return the input's dtype; the exporter's
+// --vector-ops routes the decoder layers through them.
+
+// input @ weight.T + bias with an fp32 [out_features, in_features] weight,
+// one kernels::gemv per input row and tile of output channels. Registered for
+// TorchScript as qwen::vec_linear.
+at::Tensor vec_linear(const at::Tensor& input,
+                      const at::Tensor& weight,
+                      const c10::optional<at::Tensor>& bias);
+
+// Qwen3RMSNorm over the last dimension: input * rsqrt(mean(input^2) + eps)
+// * weight. Registered for TorchScript as qwen::rms_norm.
+at::Tensor rms_norm(const at::Tensor& input, const at::Tensor& weight, double eps);
+
+// silu(gate) * up for same-shaped tensors, the activation of Qwen3MLP.
+// Registered for TorchScript as qwen::silu_mul.
+at::Tensor silu_mul(const at::Tensor& gate, const at::Tensor& up);
+
+// Softmax over the last dimension. Registered for TorchScript as
+// qwen::softmax_lastdim.
+at::Tensor softmax_lastdim(const at::Tensor& input);
+
+// Rotate-half rotary embedding of input [batch, heads, seq, head_dim] with
+// cos and sin [batch or 1, seq, head_dim], as apply_rotary_pos_emb does for
+// one of query or key. Registered for TorchScript as qwen::rope.
+at::Tensor rope(const at::Tensor& input, const at::Tensor& cos, const at::Tensor& sin);
+
+// Runs every op above on random inputs, including lengths that are not a
+// multiple of any vector length, and compares it with the ATen equivalent,
+// once per kernel table this CPU can run (see kernels::usable_kernel_tables),
+// leaving the active table as it was. Writes one line per case to out and
+// returns false if any case is off by more than fp32 rounding allows. This is
+// qwen3_infer --check-kernels, meant for validating a build on the target (or
+// under QEMU) before using it.
+bool check_vector_ops(std::ostream& out);
+
+}  // namespace qwen3
@@ -0,0 +1,361 @@
+#include "weight_packing.h"
+
+#include "packed_linear.h"
+
+#include <ATen/Context.h>
+#include <ATen/core/dispatch/Dispatcher.h>
+#include <torch/csrc/jit/api/function_impl.h>
+#include <torch/csrc/jit/ir/constants.h>
+#include <torch/csrc/jit/ir/ir.h>
+#include <torch/csrc/jit/passes/dead_code_elimination.h>
+
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+#include <vector>
+
+namespace qwen3 {
+namespace {
+using torch::jit::Block;
+using torch::jit::Node;
+using torch::jit::Value;
+
+// The tensor held by a prim::Constant node, or an undefined tensor.
+at::Tensor constant_tensor(Node* node) {
+  if (node->kind() != torch::jit::prim::Constant || !node->hasAttribute(torch::jit::attr::value) ||
+      node->kindOf(torch::jit::attr::value) != torch::jit::AttributeKind::t) {
+    return at::Tensor();
+  }
+  return node->t(torch::jit::attr::value);
+}
+
+// Weight constant feeding input 1 of a linear, or an undefined tensor.
+at::Tensor linear_weight(Node* node) {
+  if (node->kind() != torch::jit::aten::linear || node->inputs().size() != 3) {
+    return at::Tensor();
+  }
+  at::Tensor tensor = constant_tensor(node->input(1)->node());
+  if (!tensor.defined() || tensor.dim() != 2 || !tensor.is_floating_point() ||
+      !tensor.device().is_cpu()) {
+    return at::Tensor();
+  }
+  return tensor;
+}
+
+void collect_nodes(Block* block, std::vector<Node*>& nodes) {
+  for (Node* node : block->nodes()) {
+    nodes.push_back(node);
+    for (Block* sub_block : node->blocks()) {
+      collect_nodes(sub_block, nodes);
+    }
+  }
+}
+
+std::vector<std::shared_ptr<torch::jit::Graph>> module_graphs(torch::jit::Module& module) {
+  std::vector<std::shared_ptr<torch::jit::Graph>> graphs;
+  for (torch::jit::Function* function : module._ivalue()->compilation_unit()->get_functions()) {
+    if (function->isGraphFunction()) {
+      graphs.push_back(torch::jit::toGraphFunction(*function).graph());
+    }
+  }
+  return graphs;
+}
+
+// Storages of constants with any use other than the weight of a linear.
+std::unordered_set<const void*> non_linear_storages(
+    const std::vector<std::shared_ptr<torch::jit::Graph>>& graphs) {
+  std::unordered_set<const void*> shared;
+  for (const auto& graph : graphs) {
+    std::vector<Node*> nodes;
+    collect_nodes(graph->block(), nodes);
+    for (Node* node : nodes) {
+      const at::Tensor tensor = constant_tensor(node);
+      if (!tensor.defined()) {
+        continue;
+      }
+      for (const torch::jit::Use& use : node->output()->uses()) {
+        if (use.offset != 1 || !linear_weight(use.user).defined()) {
+          shared.insert(tensor.storage().data());
+          break;
+        }
+      }
+    }
+  }
+  return shared;
+}
+
+// A weight is a view of a storage: the same storage read at another offset,
+// shape or stride is a different weight.
+using ViewKey = std::tuple<const void*, int64_t, std::vector<int64_t>, std::vector<int64_t>>;
+
+ViewKey view_key(const at::Tensor& tensor) {
+  return {tensor.storage().data(), tensor.storage_offset(), tensor.sizes().vec(), tensor.strides().vec()};
+}
+
+// Linears whose weight passes linear_weight() and whose storage is not in
+// shared, grouped by weight view across every graph, in graph order. Each
+// group is rewritten and its original released before the next is packed,
+// so only one weight is ever held in both layouts.
+std::vector<std::vector<Node*>> linears_by_weight(
+    const std::vector<std::shared_ptr<torch::jit::Graph>>& graphs,
+    const std::unordered_set<const void*>& shared) {
+  std::map<ViewKey, size_t> group_of;
+  std::vector<std::vector<Node*>> groups;
+  for (const auto& graph : graphs) {
+    std::vector<Node*> nodes;
+    collect_nodes(graph->block(), nodes);
+    for (Node* node : nodes) {
+      const at::Tensor weight = linear_weight(node);
+      if (!weight.defined() || shared.count(weight.storage().data()) != 0) {
+        continue;
+      }
+      const auto inserted = group_of.emplace(view_key(weight), groups.size());
+      if (inserted.second) {
+        groups.emplace_back();
+      }
+      groups[inserted.first->second].push_back(node);
+    }
+  }
+  return groups;
+}
+
+// Sets at::Context's release-weights-when-prepacking flag for its lifetime,
+// so prepacked op contexts free their copy of the original weight.
+class ReleaseWeightsWhenPrepackingGuard {
+ public:
+  ReleaseWeightsWhenPrepackingGuard() : previous_(at::globalContext().releaseWeightsWhenPrepacking()) {
+    at::globalContext().setReleaseWeightsWhenPrepacking(true);
+  }
+  ~ReleaseWeightsWhenPrepackingGuard() { at::globalContext().setReleaseWeightsWhenPrepacking(previous_); }
+
+ private:
+  bool previous_;
+};
+
+// Destroys constants whose last use was just rewritten, dropping the graph's
+// reference to the original tensor now instead of at dead-code elimination.
+void release_constants(const std::unordered_set<Node*>& constants) {
+  for (Node* constant : constants) {
+    if (constant->output()->uses().empty()) {
+      constant->destroy();
+    }
+  }
+}
+}  // namespace
+
+int64_t pack_linear_weights(torch::jit::Module& module) {
+  const c10::Symbol packed_linear_op = c10::Symbol::fromQualString("qwen::packed_linear");
+  const std::vector<std::shared_ptr<torch::jit::Graph>> graphs = module_graphs(module);
+
+  // Storages with any use other than the weight of a linear keep their
+  // row-major layout.
+  const std::unordered_set<const void*> shared = non_linear_storages(graphs);
+
+  // The same weight may appear as a constant in several graphs; pack it once
+  // and swap it in everywhere before packing the next one.
+  const std::vector<std::vector<Node*>> groups = linears_by_weight(graphs, shared);
+  for (const std::vector<Node*>& linears : groups) {
+    std::unordered_set<Node*> originals;
+    {
+      const at::Tensor weight = linear_weight(linears.front());
+      const at::Tensor packed = pack_linear_weight(weight);
+      for (Node* node : linears) {
+        torch::jit::Graph* graph = node->owningGraph();
+        originals.insert(node->input(1)->node());
+        torch::jit::WithInsertPoint guard(node);
+        Value* packed_value = graph->insertConstant(packed);
+        Value* out_features = graph->insertConstant(weight.size(0));
+        Node* replacement = graph->create(
+            packed_linear_op, {node->input(0), packed_value, node->input(2), out_features});
+        replacement->insertBefore(node);
+        replacement->output()->setType(node->output()->type());
+        node->output()->replaceAllUsesWith(replacement->output());
+        node->destroy();
+      }
+    }
+    release_constants(originals);
+  }
+  for (const auto& graph : graphs) {
+    torch::jit::EliminateDeadCode(graph);
+  }
+  return static_cast<int64_t>(groups.size());
+}
+
+int64_t store_weights_as_bf16(torch::jit::Module& module) {
+  const c10::Symbol bf16_linear_op = c10::Symbol::fromQualString("qwen::bf16_linear");
+  const c10::Symbol bf16_embedding_op = c10::Symbol::fromQualString("qwen::bf16_embedding");
+  const c10::Symbol lm_head_argmax_op = c10::Symbol::fromQualString("qwen::lm_head_argmax");
+  const std::vector<std::shared_ptr<torch::jit::Graph>> graphs = module_graphs(module);
+
+  auto takes_bf16 = [&](const torch::jit::Use& use) {
+    const c10::Symbol kind = use.user->kind();
+    if (kind == torch::jit::aten::linear) {
+      return use.offset == 1 && use.user->inputs().size() == 3;
+    }
+    if (kind == torch::jit::aten::embedding) {
+      return use.offset == 0;
+    }
+    return kind == lm_head_argmax_op && use.offset == 1;
+  };
+  auto is_fp32_matrix = [](const at::Tensor& tensor) {
+    return tensor.defined() && tensor.dim() == 2 && tensor.scalar_type() == at::kFloat &&
+           tensor.device().is_cpu();
+  };
+
+  // A storage is converted only if every use of it can read bf16, so a weight
+  // never ends up held in both precisions.
+  std::unordered_set<const void*> usable;
+  std::unordered_set<const void*> blocked;
+  for (const auto& graph : graphs) {
+    std::vector<Node*> nodes;
+    collect_nodes(graph->block(), nodes);
+    for (Node* node : nodes) {
+      const at::Tensor tensor = constant_tensor(node);
+      if (!tensor.defined()) {
+        continue;
+      }
+      const void* storage = tensor.storage().data();
+      for (const torch::jit::Use& use : node->output()->uses()) {
+        (is_fp32_matrix(tensor) && takes_bf16(use) ? usable : blocked).insert(storage);
+      }
+    }
+  }
+
+  // Views of convertible storages, grouped across every graph in graph order:
+  // prefill and decode_step hold the same weight constants.
+  std::map<ViewKey, size_t> group_of;
+  std::vector<std::vector<Node*>> groups;
+  for (const auto& graph : graphs) {
+    std::vector<Node*> nodes;
+    collect_nodes(graph->block(), nodes);
+    for (Node* node : nodes) {
+      const at::Tensor tensor = constant_tensor(node);
+      if (!is_fp32_matrix(tensor) || usable.count(tensor.storage().data()) == 0 ||
+          blocked.count(tensor.storage().data()) != 0) {
+        continue;
+      }
+      const auto inserted = group_of.emplace(view_key(tensor), groups.size());
+      if (inserted.second) {
+        groups.emplace_back();
+      }
+      groups[inserted.first->second].push_back(node);
+    }
+  }
+
+  // Each weight is converted, swapped in everywhere and its fp32 constants
+  // released before the next one, so only one is ever held in both precisions.
+  for (const std::vector<Node*>& constants : groups) {
+    {
+      const at::Tensor converted = constant_tensor(constants.front()).to(at::kBFloat16).contiguous();
+      for (Node* node : constants) {
+        torch::jit::Graph* graph = node->owningGraph();
+        Value* weight = nullptr;
+        {
+          torch::jit::WithInsertPoint guard(node);
+          weight = graph->insertConstant(converted);
+        }
+
+        const std::vector<torch::jit::Use> uses = node->output()->uses();
+        for (const torch::jit::Use& use : uses) {
+          Node* user = use.user;
+          if (user->kind() == lm_head_argmax_op) {
+            user->replaceInput(1, weight);
+            continue;
+          }
+          Node* replacement =
+              user->kind() == torch::jit::aten::linear
+                  ? graph->create(bf16_linear_op, {user->input(0), weight, user->input(2)})
+                  : graph->create(bf16_embedding_op, {user->input(1), weight});
+          replacement->insertBefore(user);
+          replacement->output()->setType(user->output()->type());
+          user->output()->replaceAllUsesWith(replacement->output());
+          user->destroy();
+        }
+      }
+    }
+    release_constants(std::unordered_set<Node*>(constants.begin(), constants.end()));
+  }
+  for (const auto& graph : graphs) {
+    torch::jit::EliminateDeadCode(graph);
+  }
+  return static_cast<int64_t>(groups.size());
+}
+
+int64_t use_xnnpack_linear(torch::jit::Module& module) {
+  // The prepacked ops are only registered when libtorch has XNNPACK.
+  const c10::optional<c10::OperatorHandle> prepack =
+      c10::Dispatcher::singleton().findSchema({"prepacked::linear_clamp_prepack", ""});
+  if (!prepack.has_value()) {
+    throw std::runtime_error(
+        "This libtorch was built without XNNPACK; rebuild it with build_pytorch_riscv.sh --xnnpack");
+  }
+  const c10::Symbol linear_run_op = c10::Symbol::fromQualString("prepacked::linear_clamp_run");
+  const std::unordered_set<const void*> shared = non_linear_storages(module_graphs(module));
+
+  // Contexts are read through GetAttr on self, so only method graphs are
+  // rewritten.
+  std::vector<std::shared_ptr<torch::jit::Graph>> graphs;
+  for (const torch::jit::Method& method : module.get_methods()) {
+    graphs.push_back(method.graph());
+  }
+
+  // A context normally keeps the fp32 weight and bias for serialization next
+  // to XNNPACK's packed copy. These modules are never saved, so let it drop
+  // them; with the graph constants released below, each weight is then held
+  // once, in XNNPACK's layout.
+  ReleaseWeightsWhenPrepackingGuard release_weights;
+
+  // prefill and decode_step hold the same weight constants; each (weight,
+  // bias) pair is packed once and every method reads the same attribute.
+  int64_t packed = 0;
+  for (const std::vector<Node*>& linears : linears_by_weight(graphs, shared)) {
+    std::unordered_set<Node*> originals;
+    {
+      const at::Tensor weight = linear_weight(linears.front());
+      if (weight.scalar_type() != at::kFloat) {
+        continue;
+      }
+      // Linears sharing a weight practically always share the bias too.
+      std::map<std::vector<ViewKey>, std::string> attribute_by_bias;
+      for (Node* node : linears) {
+        const c10::optional<c10::IValue> bias = torch::jit::toIValue(node->input(2));
+        if (!bias.has_value() ||
+            !(bias->isNone() || (bias->isTensor() && bias->toTensor().scalar_type() == at::kFloat))) {
+          continue;
+        }
+        std::vector<ViewKey> bias_key;
+        if (bias->isTensor()) {
+          bias_key.push_back(view_key(bias->toTensor()));
+        }
+        std::string& attribute = attribute_by_bias[bias_key];
+        if (attribute.empty()) {
+          // linear_clamp_prepack(W, B, output_min, output_max); no clamp.
+          torch::jit::Stack stack{weight, *bias, c10::IValue(), c10::IValue()};
+          prepack->callBoxed(&stack);
+          attribute = "xnnpack_linear_" + std::to_string(packed++);
+          module.register_attribute(attribute, stack.front().type(), stack.front());
+        }
+
+        torch::jit::Graph* graph = node->owningGraph();
+        originals.insert(node->input(1)->node());
+        originals.insert(node->input(2)->node());
+        torch::jit::WithInsertPoint guard(node);
+        Value* context = graph->insertGetAttr(graph->inputs()[0], attribute);
+        Node* replacement = graph->create(linear_run_op, {node->input(0), context});
+        replacement->insertBefore(node);
+        replacement->output()->setType(node->output()->type());
+        node->output()->replaceAllUsesWith(replacement->output());
+        node->destroy();
+      }
+    }
+    release_constants(originals);
+  }
+  for (const auto& graph : graphs) {
+    torch::jit::EliminateDeadCode(graph);
+  }
+  return packed;
+}
+
+}  // namespace qwen3
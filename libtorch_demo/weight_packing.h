@@ -0,0 +1,40 @@
+#pragma once
+
+#include <torch/script.h>
+
+#include <cstdint>
+
+namespace qwen3 {
+
+// Rewrites every aten::linear in the module's graphs whose weight is a frozen
+// constant into qwen::packed_linear over a panel-major copy of that weight
+// (see packed_linear.h). Weights that are also read by anything other than a
+// linear, such as an lm_head tied to the embedding table, are left alone so
+// the model never holds both layouts. Each weight is swapped in everywhere and
+// its original released before the next is packed, so peak memory is the
+// model plus one weight. Must run before any method executes. Returns the
+// number of weights packed.
+int64_t pack_linear_weights(torch::jit::Module& module);
+
+// Converts every fp32 weight constant read only by aten::linear,
+// aten::embedding or qwen::lm_head_argmax to bf16, rewriting those calls to
+// qwen::bf16_linear / qwen::bf16_embedding (see bf16_weights.h). Activations
+// stay fp32. As in pack_linear_weights, each weight's fp32 constants are
+// released before the next is converted, so peak memory is the model plus
+// one bf16 weight. Must run before any method executes. Returns the number of
+// weights converted.
+int64_t store_weights_as_bf16(torch::jit::Module& module);
+
+// Rewrites every aten::linear in the module's methods whose fp32 weight (and
+// bias, if any) is a frozen constant into prepacked::linear_clamp_run over an
+// XNNPACK context packed here, held as a module attribute. Weights shared
+// with other ops are left alone, as in pack_linear_weights. The contexts drop
+// their fp32 originals (so the module can no longer be saved) and each
+// weight's constants are released as soon as it is packed: the rewritten
+// weights take about their fp32 size once, and loading peaks at the model
+// plus one weight. Throws std::runtime_error if libtorch was built without
+// XNNPACK. Must run before any method executes. Returns the number of
+// contexts packed.
+int64_t use_xnnpack_linear(torch::jit::Module& module);
+
+}  // namespace qwen3
@@ -42,6 +42,24 @@ if [ ! -f "$PROMPT" ]; then
   exit 1
 fi
 
+# A resident server (qwen3_infer --serve) already holds the model; skip staging
+# and the load entirely.
+if [ -n "${QWEN_SERVER_SOCKET:-}" ] && [ -S "$QWEN_SERVER_SOCKET" ]; then
+  /usr/local/bin/qwen3_infer --connect "$QWEN_SERVER_SOCKET" "$PROMPT" "$OUTPUT" "$MAX_NEW_TOKENS"
+  printf 'Qwen output tokens written to %s\n' "$OUTPUT"
+  cat "$OUTPUT"
+  exit 0
+fi
+
+# qwen3_infer loads a .ts.gz as-is without holding the inflated archive and
+# the weights at once, so the archive is only staged decompressed when
+# QWEN_STAGE_MODEL=1 asks for it.
+if [ ! -f "$MODEL_PATH" ] && [ "$MODEL_EXT" = "gz" ] && [ -f "$MODEL_ARCHIVE" ]; then
+  case "${QWEN_STAGE_MODEL:-0}" in
+    0|false|FALSE|no|NO) MODEL_PATH="$MODEL_ARCHIVE" ;;
+  esac
+fi
+
 if [ ! -f "$MODEL_PATH" ]; then
   if [ ! -f "$MODEL_ARCHIVE" ]; then
     echo "Model source not found. Expected either $MODEL_PATH or $MODEL_ARCHIVE" >&2
@@ -74,6 +92,16 @@ if [ ! -f "$MODEL_PATH" ]; then
   fi
 fi
 
-/usr/local/bin/qwen3_infer "$MODEL_PATH" "$PROMPT" "$OUTPUT" "$MAX_NEW_TOKENS" "$EOS_TOKEN"
+# QWEN_PREFIX_CACHE names a directory of prompt KV caches; on the host share it
+# survives reboots, so the bundled prompt is only prefilled once.
+if [ -n "${QWEN_PREFIX_CACHE:-}" ]; then
+  set -- --prefix-cache "$QWEN_PREFIX_CACHE"
+else
+  set --
+fi
+
+# QWEN_INFER_ARGS carries extra qwen3_infer options (e.g. "--temperature 0.7 --top-k 40").
+# shellcheck disable=SC2086
+/usr/local/bin/qwen3_infer ${QWEN_INFER_ARGS:-} "$@" "$MODEL_PATH" "$PROMPT" "$OUTPUT" "$MAX_NEW_TOKENS" "$EOS_TOKEN"
 printf 'Qwen output tokens written to %s\n' "$OUTPUT"
 cat "$OUTPUT"
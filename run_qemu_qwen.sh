@@ -40,6 +40,19 @@ MSG
     exit 1
   fi
 
+  # qwen3_infer loads the .ts.gz directly, handing the inflated pages back as
+  # the weights are copied out, so no decompressed copy is needed.
+  # DECOMPRESS_MODEL=1 writes one next to the archive anyway (e.g. for --mmap
+  # or a qwen3_infer built without zlib).
+  if [ "$(dirname "$MODEL_ARCHIVE")" -ef "$MODEL_DIR" ]; then
+    case "${DECOMPRESS_MODEL:-0}" in
+      0|false|FALSE|no|NO)
+        MODEL_TS="$MODEL_ARCHIVE"
+        return
+        ;;
+    esac
+  fi
+
   echo "Preparing host-side TorchScript model at $MODEL_TS (this may take a minute)..."
   tmp="$MODEL_TS.tmp"
   if ! gzip -dc "$MODEL_ARCHIVE" > "$tmp"; then